@@ -4,5 +4,5 @@
 
 USER_OBJS :=
 
-#LIBS := -lOpenNI
+#LIBS := -lOpenNI -lfreenect	# together with -DHAVE_OPENNI
 LIBS := -lfreenect
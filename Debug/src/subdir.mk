@@ -4,13 +4,61 @@
 
 # Add inputs and outputs from these tool invocations to the build variables
 CPP_SRCS += \
-../src/KinectTouch.cpp
+../src/ActiveArea.cpp \
+../src/BackgroundModel.cpp \
+../src/BackgroundSnapshot.cpp \
+../src/Benchmark.cpp \
+../src/DepthCodec.cpp \
+../src/DepthConvert.cpp \
+../src/DepthRecording.cpp \
+../src/FileDepthSensor.cpp \
+../src/KinectSensor.cpp \
+../src/KinectTouch.cpp \
+../src/OpenNISensor.cpp \
+../src/RunLabeller.cpp \
+../src/StripePool.cpp \
+../src/SyntheticDepthSensor.cpp \
+../src/TouchDetector.cpp \
+../src/TouchKernels.cpp \
+../src/TouchSensor.cpp
 
 OBJS += \
-./src/KinectTouch.o
+./src/ActiveArea.o \
+./src/BackgroundModel.o \
+./src/BackgroundSnapshot.o \
+./src/Benchmark.o \
+./src/DepthCodec.o \
+./src/DepthConvert.o \
+./src/DepthRecording.o \
+./src/FileDepthSensor.o \
+./src/KinectSensor.o \
+./src/KinectTouch.o \
+./src/OpenNISensor.o \
+./src/RunLabeller.o \
+./src/StripePool.o \
+./src/SyntheticDepthSensor.o \
+./src/TouchDetector.o \
+./src/TouchKernels.o \
+./src/TouchSensor.o
 
 CPP_DEPS += \
-./src/KinectTouch.d
+./src/ActiveArea.d \
+./src/BackgroundModel.d \
+./src/BackgroundSnapshot.d \
+./src/Benchmark.d \
+./src/DepthCodec.d \
+./src/DepthConvert.d \
+./src/DepthRecording.d \
+./src/FileDepthSensor.d \
+./src/KinectSensor.d \
+./src/KinectTouch.d \
+./src/OpenNISensor.d \
+./src/RunLabeller.d \
+./src/StripePool.d \
+./src/SyntheticDepthSensor.d \
+./src/TouchDetector.d \
+./src/TouchKernels.d \
+./src/TouchSensor.d
 
 
 # Each subdirectory must supply rules for building sources it contributes
@@ -0,0 +1,148 @@
+//============================================================================
+// Name        : ActiveArea.cpp
+// Description : part of the sensor image covering the touch surface
+//============================================================================
+
+#include "ActiveArea.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+using namespace std;
+
+ActiveArea::ActiveArea(int width, int height)
+	: width(width)
+	, height(height)
+	, pixels(0)
+{
+	setRect(0, 0, width, height);
+}
+
+void ActiveArea::setRect(int x, int y, int w, int h) {
+	int x0 = max(x, 0), x1 = min(x + w, width);
+	int y0 = max(y, 0), y1 = min(y + h, height);
+
+	spans.clear();
+	rowStart.assign(height + 1, 0);
+	for (int row = 0; row < height; row++) {
+		rowStart[row] = spans.size();
+		if (row >= y0 && row < y1 && x0 < x1) {
+			AreaSpan span = { x0, x1 };
+			spans.push_back(span);
+		}
+	}
+	rowStart[height] = spans.size();
+	compile();
+}
+
+void ActiveArea::setPolygon(const vector<AreaPoint>& polygon) {
+	spans.clear();
+	rowStart.assign(height + 1, 0);
+	vector<float> crossings;
+	int n = polygon.size();
+	for (int row = 0; row < height; row++) {
+		rowStart[row] = spans.size();
+
+		// edges crossing the line through the pixel centers
+		float yc = row + 0.5f;
+		crossings.clear();
+		for (int i = 0; i < n; i++) {
+			const AreaPoint& a = polygon[i];
+			const AreaPoint& b = polygon[(i + 1) % n];
+			if ((a.y <= yc) != (b.y <= yc)) {
+				crossings.push_back(a.x + (yc - a.y) * (b.x - a.x) / (b.y - a.y));
+			}
+		}
+		sort(crossings.begin(), crossings.end());
+
+		// pixel x is inside if its center x + 0.5 lies between a pair of crossings
+		for (unsigned int i = 0; i + 1 < crossings.size(); i += 2) {
+			int x0 = max((int)ceilf(crossings[i] - 0.5f), 0);
+			int x1 = min((int)ceilf(crossings[i + 1] - 0.5f), width);
+			if (x0 < x1) {
+				if ((int)spans.size() > rowStart[row] && spans.back().x1 >= x0) {
+					spans.back().x1 = max(spans.back().x1, x1);
+				} else {
+					AreaSpan span = { x0, x1 };
+					spans.push_back(span);
+				}
+			}
+		}
+	}
+	rowStart[height] = spans.size();
+	compile();
+}
+
+bool ActiveArea::parsePolygon(const char* text, vector<AreaPoint>& polygon) {
+	polygon.clear();
+	for (;;) {
+		AreaPoint p;
+		int length;
+		if (sscanf(text, "%f,%f%n", &p.x, &p.y, &length) != 2) {
+			return false;
+		}
+		polygon.push_back(p);
+		text += length;
+		if (*text == 0) {
+			break;
+		}
+		if (*text++ != ';') {
+			return false;
+		}
+	}
+	return polygon.size() >= 3;
+}
+
+// bit mask and pixel count of the spans
+void ActiveArea::compile() {
+	const int wordsPerRow = width / 64;
+	mask.assign(wordsPerRow * height, 0);
+	pixels = 0;
+	for (int y = 0; y < height; y++) {
+		uint64_t* m = &mask[y * wordsPerRow];
+		for (int i = rowStart[y]; i < rowStart[y + 1]; i++) {
+			for (int x = spans[i].x0; x < spans[i].x1; x++) {
+				m[x / 64] |= 1ull << (x % 64);
+			}
+			pixels += spans[i].x1 - spans[i].x0;
+		}
+	}
+}
+
+void ActiveArea::getWordRange(int y, int& k0, int& k1) const {
+	if (rowStart[y] == rowStart[y + 1]) {
+		k0 = k1 = 0;
+		return;
+	}
+	k0 = spans[rowStart[y]].x0 / 64;
+	k1 = (spans[rowStart[y + 1] - 1].x1 + 63) / 64;
+}
+
+void ActiveArea::getBounds(int& x0, int& y0, int& x1, int& y1) const {
+	x0 = width;
+	y0 = height;
+	x1 = y1 = 0;
+	for (int y = 0; y < height; y++) {
+		for (int i = rowStart[y]; i < rowStart[y + 1]; i++) {
+			x0 = min(x0, spans[i].x0);
+			x1 = max(x1, spans[i].x1);
+			y0 = min(y0, y);
+			y1 = y + 1;
+		}
+	}
+	if (x1 == 0) {
+		x0 = y0 = 0;
+	}
+}
+
+uint32_t ActiveArea::getChecksum() const {
+	// FNV-1a over the mask words
+	uint32_t hash = 2166136261u;
+	for (unsigned int i = 0; i < mask.size(); i++) {
+		for (int b = 0; b < 64; b += 8) {
+			hash = (hash ^ (uint32_t)((mask[i] >> b) & 0xff)) * 16777619u;
+		}
+	}
+	return hash;
+}
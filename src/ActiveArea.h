@@ -0,0 +1,66 @@
+//============================================================================
+// Name        : ActiveArea.h
+// Description : part of the sensor image covering the touch surface
+//============================================================================
+
+#ifndef INCLUDED_ActiveArea_H
+#define INCLUDED_ActiveArea_H
+
+#include <vector>
+#include <stdint.h>
+
+struct AreaPoint {
+	float x, y;		// pixels
+};
+
+// pixels [x0, x1) of a row
+struct AreaSpan {
+	int x0, x1;
+};
+
+/*
+ * the active area of a sensor: a polygon (even-odd rule, pixel centers
+ * inside it belong to the area) or a rectangle, compiled once into the
+ * spans of every row and into a bit mask in the layout of the valid mask
+ * (see buildValidMask). the per pixel stages only visit the spans, pixels
+ * outside are never looked at. the width must be a multiple of 64.
+ */
+class ActiveArea {
+public:
+	ActiveArea(int width = 640, int height = 480);	// the whole frame
+
+	void setRect(int x, int y, int width, int height);
+	void setPolygon(const std::vector<AreaPoint>& polygon);
+
+	// "x,y;x,y;..." in pixels, false if the text is no polygon
+	static bool parsePolygon(const char* text, std::vector<AreaPoint>& polygon);
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+
+	const AreaSpan* getSpans(int y) const { return &spans[0] + rowStart[y]; }
+	int getSpanCount(int y) const { return rowStart[y + 1] - rowStart[y]; }
+
+	// mask words [k0, k1) of row y cover all its spans (k0 == k1 for empty rows)
+	void getWordRange(int y, int& k0, int& k1) const;
+
+	const uint64_t* getMask() const { return &mask[0]; }
+
+	// bounding box, x1 and y1 exclusive (all 0 if the area is empty)
+	void getBounds(int& x0, int& y0, int& x1, int& y1) const;
+	int getPixels() const { return pixels; }
+
+	// changes whenever the area does (stored in background snapshots)
+	uint32_t getChecksum() const;
+
+private:
+	int width, height;
+	std::vector<AreaSpan> spans;
+	std::vector<int> rowStart;		// first span of every row, height + 1 entries
+	std::vector<uint64_t> mask;
+	int pixels;
+
+	void compile();
+};
+
+#endif
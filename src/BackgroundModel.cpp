@@ -0,0 +1,328 @@
+//============================================================================
+// Name        : BackgroundModel.cpp
+// Description : depth model of the empty surface
+//============================================================================
+
+#include "BackgroundModel.h"
+
+#include <string.h>
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define BACKGROUND_X86_SIMD
+#include <immintrin.h>
+#endif
+
+//---------------------------------------------------------------------------
+// training
+//---------------------------------------------------------------------------
+
+BackgroundTrainer::BackgroundTrainer(int width, int height)
+	: size(width * height)
+	, frames(0)
+{
+	sum = new uint64_t[size];
+	sumSquares = new uint64_t[size];
+	count = new uint32_t[size];
+	reset();
+}
+
+BackgroundTrainer::~BackgroundTrainer() {
+	delete[] count;
+	delete[] sumSquares;
+	delete[] sum;
+}
+
+void BackgroundTrainer::reset() {
+	frames = 0;
+	memset(sum, 0, size * sizeof(uint64_t));
+	memset(sumSquares, 0, size * sizeof(uint64_t));
+	memset(count, 0, size * sizeof(uint32_t));
+}
+
+void BackgroundTrainer::add(const uint16_t* depth, const uint64_t* valid) {
+	frames++;
+
+	for (int w = 0; w < size / 64; w++) {
+		uint64_t m = valid[w];
+		int i = w * 64;
+		if (m == ~(uint64_t)0) {
+			// the common case: 64 pixels with a reading
+			for (int j = i; j < i + 64; j++) {
+				uint32_t d = depth[j];
+				sum[j] += d;
+				sumSquares[j] += (uint64_t)d * d;
+				count[j]++;
+			}
+		} else {
+			for (; m != 0; m &= m - 1) {
+				int j = i + __builtin_ctzll(m);
+				uint32_t d = depth[j];
+				sum[j] += d;
+				sumSquares[j] += (uint64_t)d * d;
+				count[j]++;
+			}
+		}
+	}
+}
+
+void BackgroundTrainer::getMean(short* mean, unsigned int minValid) const {
+	if (minValid < 1) {
+		minValid = 1;
+	}
+	for (int i = 0; i < size; i++) {
+		mean[i] = count[i] >= minValid ? (short)((sum[i] + count[i] / 2) / count[i]) : 0;
+	}
+}
+
+void BackgroundTrainer::getStdDev(float* stddev) const {
+	for (int i = 0; i < size; i++) {
+		uint64_t n = count[i];
+		if (n < 2) {
+			stddev[i] = 0;
+			continue;
+		}
+		double mean = (double)sum[i] / n;
+		double variance = (double)sumSquares[i] / n - mean * mean;
+		stddev[i] = variance > 0 ? (float)sqrt(variance) : 0;
+	}
+}
+
+HistogramTrainer::HistogramTrainer(int width, int height)
+	: size(width * height)
+	, shift(4)
+	, frames(0)
+{
+	histogram = new uint8_t[size * bins];
+	first = new uint16_t[size];
+	reset(shift);
+}
+
+HistogramTrainer::~HistogramTrainer() {
+	delete[] first;
+	delete[] histogram;
+}
+
+void HistogramTrainer::reset(int binShift) {
+	shift = binShift;
+	frames = 0;
+	memset(histogram, 0, size * bins);
+	memset(first, 0, size * sizeof(uint16_t));
+}
+
+void HistogramTrainer::add(const uint16_t* depth, const uint64_t* valid) {
+	frames++;
+
+	for (int w = 0; w < size / 64; w++) {
+		for (uint64_t m = valid[w]; m != 0; m &= m - 1) {
+			int i = w * 64 + __builtin_ctzll(m);
+			int q = depth[i] >> shift;
+			if (first[i] == 0) {
+				first[i] = q > binsInFront ? q - binsInFront : 1;
+			}
+			unsigned int bin = q - first[i];
+			if (bin >= (unsigned int)bins) {
+				continue;	// far from the surface
+			}
+			uint8_t* h = histogram + i * bins;
+			if (h[bin] == 255) {
+				for (int j = 0; j < bins; j++) {
+					h[j] >>= 1;
+				}
+			}
+			h[bin]++;
+		}
+	}
+}
+
+void HistogramTrainer::getMedian(short* median) const {
+	for (int i = 0; i < size; i++) {
+		const uint8_t* h = histogram + i * bins;
+		int total = 0;
+		for (int j = 0; j < bins; j++) {
+			total += h[j];
+		}
+		median[i] = 0;
+		int cumulative = 0;
+		for (int j = 0; j < bins && total > 0; j++) {
+			cumulative += h[j];
+			if (2 * cumulative >= total) {
+				median[i] = (short)(((first[i] + j) << shift) + (1 << shift) / 2);
+				break;
+			}
+		}
+	}
+}
+
+void restrictValidMask(const uint16_t* depth, const short* reference, int tolerance, const uint64_t* valid, uint64_t* restricted, int n) {
+	for (int w = 0; w < n / 64; w++) {
+		uint64_t r = 0;
+		for (uint64_t m = valid[w]; m != 0; m &= m - 1) {
+			int j = __builtin_ctzll(m);
+			int i = w * 64 + j;
+			int delta = depth[i] - reference[i];
+			if (reference[i] != 0 && delta <= tolerance && delta >= -tolerance) {
+				r |= (uint64_t)1 << j;
+			}
+		}
+		restricted[w] = r;
+	}
+}
+
+//---------------------------------------------------------------------------
+// hole filling
+//---------------------------------------------------------------------------
+
+// fills the holes of one line (pixels step apart), returns the number of filled pixels
+static int fillLine(short* b, float* s, int n, int step, int maxGap) {
+	int filled = 0;
+	int last = -1;	// last pixel with a value
+	for (int i = 0; i < n; i++) {
+		if (b[i * step] == 0) {
+			continue;
+		}
+		int gap = i - last - 1;
+		if (last >= 0 && gap > 0 && gap <= maxGap) {
+			int b0 = b[last * step], b1 = b[i * step];
+			float s0 = s[last * step], s1 = s[i * step];
+			for (int j = last + 1; j < i; j++) {
+				b[j * step] = (short)(b0 + (b1 - b0) * (j - last) / (gap + 1));
+				s[j * step] = s0 > s1 ? s0 : s1;
+			}
+			filled += gap;
+		}
+		last = i;
+	}
+	return filled;
+}
+
+int fillBackgroundHoles(short* background, float* stddev, int width, int height, int maxGap) {
+	int filled = 0;
+	for (int y = 0; y < height; y++) {
+		filled += fillLine(background + y * width, stddev + y * width, width, 1, maxGap);
+	}
+	for (int x = 0; x < width; x++) {
+		filled += fillLine(background + x, stddev + x, height, width, maxGap);
+	}
+	return filled;
+}
+
+//---------------------------------------------------------------------------
+// adaption
+//---------------------------------------------------------------------------
+
+// band offsets and bands
+struct AdaptBands {
+	const int16_t* lower;
+	const int16_t* upper;
+	int16_t* near;
+	int16_t* far;
+};
+
+static void adaptScalar(int16_t* background, const uint16_t* depth, uint16_t invalid, int coverDepth, const AdaptBands* bands, int from, int n) {
+	for (int i = from; i < n; i++) {
+		int d = depth[i];
+		int b = background[i];
+		if (d == 0 || d == invalid) {
+		} else if (b == 0) {
+			background[i] = b = d;
+		} else if (b - d < coverDepth) {
+			background[i] = b = b + (d > b) - (d < b);
+		}
+		if (bands) {
+			bands->near[i] = b ? b - bands->upper[i] : 0;
+			bands->far[i] = b ? b - bands->lower[i] : 0;
+		}
+	}
+}
+
+#ifdef BACKGROUND_X86_SIMD
+/*
+ * per lane: up/down are -1 where the background has to move, the step
+ * (down - up) is masked to the uncovered valid pixels. depth values fit
+ * into int16_t (at most 10000 mm or 2047). the bands are written from the
+ * adapted background while it is still in a register.
+ */
+__attribute__((target("sse2")))
+static void adaptSSE2(int16_t* background, const uint16_t* depth, uint16_t invalid, int coverDepth, const AdaptBands* bands, int n) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i invalidValue = _mm_set1_epi16(invalid);
+	const __m128i cover = _mm_set1_epi16(coverDepth);
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i d = _mm_loadu_si128((const __m128i*)(depth + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(background + i));
+		__m128i invalidMask = _mm_or_si128(_mm_cmpeq_epi16(d, zero), _mm_cmpeq_epi16(d, invalidValue));
+		__m128i uncovered = _mm_cmpgt_epi16(cover, _mm_subs_epi16(b, d));
+		__m128i mask = _mm_andnot_si128(invalidMask, uncovered);
+		__m128i step = _mm_sub_epi16(_mm_cmpgt_epi16(b, d), _mm_cmpgt_epi16(d, b));
+		__m128i adapted = _mm_add_epi16(b, _mm_and_si128(step, mask));
+		__m128i empty = _mm_andnot_si128(invalidMask, _mm_cmpeq_epi16(b, zero));
+		adapted = _mm_or_si128(_mm_and_si128(empty, d), _mm_andnot_si128(empty, adapted));
+		_mm_storeu_si128((__m128i*)(background + i), adapted);
+		if (bands) {
+			__m128i known = _mm_cmpeq_epi16(_mm_cmpeq_epi16(adapted, zero), zero);
+			__m128i lower = _mm_loadu_si128((const __m128i*)(bands->lower + i));
+			__m128i upper = _mm_loadu_si128((const __m128i*)(bands->upper + i));
+			_mm_storeu_si128((__m128i*)(bands->near + i), _mm_and_si128(known, _mm_sub_epi16(adapted, upper)));
+			_mm_storeu_si128((__m128i*)(bands->far + i), _mm_and_si128(known, _mm_sub_epi16(adapted, lower)));
+		}
+	}
+	adaptScalar(background, depth, invalid, coverDepth, bands, i, n);
+}
+
+__attribute__((target("avx2")))
+static void adaptAVX2(int16_t* background, const uint16_t* depth, uint16_t invalid, int coverDepth, const AdaptBands* bands, int n) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i invalidValue = _mm256_set1_epi16(invalid);
+	const __m256i cover = _mm256_set1_epi16(coverDepth);
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m256i d = _mm256_loadu_si256((const __m256i*)(depth + i));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(background + i));
+		__m256i invalidMask = _mm256_or_si256(_mm256_cmpeq_epi16(d, zero), _mm256_cmpeq_epi16(d, invalidValue));
+		__m256i uncovered = _mm256_cmpgt_epi16(cover, _mm256_subs_epi16(b, d));
+		__m256i mask = _mm256_andnot_si256(invalidMask, uncovered);
+		__m256i step = _mm256_sub_epi16(_mm256_cmpgt_epi16(b, d), _mm256_cmpgt_epi16(d, b));
+		__m256i adapted = _mm256_add_epi16(b, _mm256_and_si256(step, mask));
+		__m256i empty = _mm256_andnot_si256(invalidMask, _mm256_cmpeq_epi16(b, zero));
+		adapted = _mm256_blendv_epi8(adapted, d, empty);
+		_mm256_storeu_si256((__m256i*)(background + i), adapted);
+		if (bands) {
+			__m256i known = _mm256_cmpeq_epi16(_mm256_cmpeq_epi16(adapted, zero), zero);
+			__m256i lower = _mm256_loadu_si256((const __m256i*)(bands->lower + i));
+			__m256i upper = _mm256_loadu_si256((const __m256i*)(bands->upper + i));
+			_mm256_storeu_si256((__m256i*)(bands->near + i), _mm256_and_si256(known, _mm256_sub_epi16(adapted, upper)));
+			_mm256_storeu_si256((__m256i*)(bands->far + i), _mm256_and_si256(known, _mm256_sub_epi16(adapted, lower)));
+		}
+	}
+	adaptScalar(background, depth, invalid, coverDepth, bands, i, n);
+}
+#endif
+
+typedef void (*AdaptFunc)(int16_t*, const uint16_t*, uint16_t, int, const AdaptBands*, int);
+
+static void adaptPlain(int16_t* background, const uint16_t* depth, uint16_t invalid, int coverDepth, const AdaptBands* bands, int n) {
+	adaptScalar(background, depth, invalid, coverDepth, bands, 0, n);
+}
+
+static AdaptFunc selectAdapt() {
+#ifdef BACKGROUND_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return adaptAVX2;
+	if (__builtin_cpu_supports("sse2")) return adaptSSE2;
+#endif
+	return adaptPlain;
+}
+
+static const AdaptFunc adapt = selectAdapt();
+
+void adaptBackground(int16_t* background, const uint16_t* depth, uint16_t invalidDepth, int coverDepth, int n) {
+	adapt(background, depth, invalidDepth, coverDepth, NULL, n);
+}
+
+void adaptBackgroundBands(int16_t* background, const uint16_t* depth, uint16_t invalidDepth, int coverDepth,
+		const int16_t* lower, const int16_t* upper, int16_t* near, int16_t* far, int n) {
+	AdaptBands bands = { lower, upper, near, far };
+	adapt(background, depth, invalidDepth, coverDepth, &bands, n);
+}
@@ -0,0 +1,119 @@
+//============================================================================
+// Name        : BackgroundModel.h
+// Description : depth model of the empty surface
+//============================================================================
+
+#ifndef INCLUDED_BackgroundModel_H
+#define INCLUDED_BackgroundModel_H
+
+#include <stdint.h>
+
+/*
+ * learns the background from any number of frames, one frame at a time.
+ * keeps an integer sum and sum of squares per pixel instead of the frames
+ * themselves. pixels without a reading (cleared bits in the validity mask,
+ * see buildValidMask) are left out, so a pixel that dropped out in some
+ * frames still gets the mean of the frames where it was seen.
+ */
+class BackgroundTrainer {
+public:
+	BackgroundTrainer(int width = 640, int height = 480);
+	~BackgroundTrainer();
+
+	void reset();
+	void add(const uint16_t* depth, const uint64_t* valid);
+
+	unsigned int getFrameCount() const { return frames; }
+
+	// rounded mean depth per pixel, 0 where the pixel was valid in less than minValid frames
+	void getMean(short* mean, unsigned int minValid = 1) const;
+	// standard deviation per pixel (mm), 0 where the pixel was valid less than twice
+	void getStdDev(float* stddev) const;
+
+private:
+	int size;
+	unsigned int frames;
+
+	uint64_t* sum;
+	uint64_t* sumSquares;
+	uint32_t* count;		// frames in which the pixel was valid
+
+	BackgroundTrainer(const BackgroundTrainer&);
+	BackgroundTrainer& operator=(const BackgroundTrainer&);
+};
+
+/*
+ * robust first stage of training: a small histogram per pixel, whose
+ * median survives hands and arms that cover the pixel in less than half
+ * of the frames. depth is quantized to bins of 2^binShift units. the 16
+ * bins of a pixel start 4 bins in front of its first reading, so they
+ * reach 12 bins behind it: objects are always in front of the surface,
+ * which therefore stays inside the histogram even if the first reading
+ * was a hand. counts are 8 bit and halved when one would overflow.
+ * 18 bytes per pixel.
+ */
+class HistogramTrainer {
+public:
+	HistogramTrainer(int width = 640, int height = 480);
+	~HistogramTrainer();
+
+	void reset(int binShift);
+	void add(const uint16_t* depth, const uint64_t* valid);
+
+	unsigned int getFrameCount() const { return frames; }
+	int getBinSize() const { return 1 << shift; }
+
+	// center of the median bin per pixel, 0 where the pixel was never valid
+	void getMedian(short* median) const;
+
+private:
+	static const int bins = 16;
+	static const int binsInFront = 4;
+
+	int size;
+	int shift;
+	unsigned int frames;
+	uint8_t* histogram;		// bins per pixel
+	uint16_t* first;		// quantized depth of the first bin, 0: no reading yet
+
+	HistogramTrainer(const HistogramTrainer&);
+	HistogramTrainer& operator=(const HistogramTrainer&);
+};
+
+/*
+ * clears the bits of valid for pixels more than tolerance away from
+ * reference (or without reference), writes the result to restricted.
+ * used to train mean and deviation only on samples near the median.
+ */
+void restrictValidMask(const uint16_t* depth, const short* reference, int tolerance, const uint64_t* valid, uint64_t* restricted, int n);
+
+/*
+ * fills holes (0) in the background that are at most maxGap pixels wide
+ * by interpolating between the pixels left and right of the hole, then
+ * between the pixels above and below. stddev of a filled pixel is the
+ * larger one of the two ends. larger holes (shadows) are left alone.
+ * returns the number of filled pixels.
+ */
+int fillBackgroundHoles(short* background, float* stddev, int width, int height, int maxGap);
+
+/*
+ * follows slow changes of the empty surface (sensor warm up, moved
+ * objects, sunlight). moves every background pixel one unit towards depth,
+ * which tracks the median of the pixel over time and ignores noise spikes.
+ * pixels that are covered (background - depth >= coverDepth, i.e. touches,
+ * hands and arms) or have no reading (0 or invalidDepth) are kept.
+ * background pixels that never had a reading (0) take the depth directly.
+ * uses AVX2 or SSE2 when the cpu supports it.
+ */
+void adaptBackground(int16_t* background, const uint16_t* depth, uint16_t invalidDepth, int coverDepth, int n);
+
+/*
+ * the same, and moves the touch band of every pixel with its background in
+ * that pass: near = background - upper and far = background - lower (both
+ * 0 where the background is 0). lower and upper are the per pixel band
+ * offsets, which only change with the noise model.
+ */
+void adaptBackgroundBands(int16_t* background, const uint16_t* depth, uint16_t invalidDepth, int coverDepth,
+		const int16_t* lower, const int16_t* upper, int16_t* near, int16_t* far, int n);
+
+#endif
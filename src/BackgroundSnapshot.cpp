@@ -0,0 +1,149 @@
+//============================================================================
+// Name        : BackgroundSnapshot.cpp
+// Description : trained background and calibration saved for a warm start
+//============================================================================
+
+#include "BackgroundSnapshot.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <string>
+
+using namespace std;
+
+static bool writeAll(int fd, const void* buf, size_t len) {
+	const char* p = (const char*)buf;
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+static uint32_t align16(uint32_t offset) {
+	return (offset + 15) & ~15u;
+}
+
+BackgroundSnapshot::BackgroundSnapshot()
+	: data(NULL)
+	, size(0)
+	, header(NULL)
+{
+}
+
+BackgroundSnapshot::~BackgroundSnapshot() {
+	close();
+}
+
+int BackgroundSnapshot::open(const char* fileName) {
+	int fd = ::open(fileName, O_RDONLY);
+	if (fd < 0) {
+		return -1;	// no snapshot yet
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+		printf("%s: not a background snapshot\n", fileName);
+		::close(fd);
+		return -1;
+	}
+	size = st.st_size;
+
+	void* p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED) {
+		printf("Could not map %s\n", fileName);
+		return -1;
+	}
+	data = (uint8_t*)p;
+	header = (const SnapshotHeader*)data;
+
+	uint64_t pixels = (uint64_t)header->width * header->height;
+	if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0
+			|| header->version != SNAPSHOT_VERSION
+			|| header->headerSize != sizeof(SnapshotHeader)
+			|| header->backgroundOffset + pixels * sizeof(int16_t) > size
+			|| header->stddevOffset + pixels * sizeof(float) > size) {
+		printf("%s: unsupported or damaged background snapshot\n", fileName);
+		close();
+		return -1;
+	}
+	return 0;
+}
+
+void BackgroundSnapshot::close() {
+	if (data) {
+		munmap(data, size);
+		data = NULL;
+		size = 0;
+		header = NULL;
+	}
+}
+
+int BackgroundSnapshot::save(const char* fileName, SnapshotHeader& header, const int16_t* background, const float* stddev) {
+	uint32_t pixels = header.width * header.height;
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	header.version = SNAPSHOT_VERSION;
+	header.headerSize = sizeof(SnapshotHeader);
+	header.backgroundOffset = align16(sizeof(SnapshotHeader));
+	header.stddevOffset = align16(header.backgroundOffset + pixels * sizeof(int16_t));
+
+	string tmpName = string(fileName) + ".tmp";
+	int fd = ::open(tmpName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		printf("Could not create %s\n", tmpName.c_str());
+		return -1;
+	}
+
+	static const uint8_t padding[16] = { 0 };
+	bool ok = writeAll(fd, &header, sizeof(header))
+			&& writeAll(fd, padding, header.backgroundOffset - sizeof(header))
+			&& writeAll(fd, background, pixels * sizeof(int16_t))
+			&& writeAll(fd, padding, header.stddevOffset - header.backgroundOffset - pixels * sizeof(int16_t))
+			&& writeAll(fd, stddev, pixels * sizeof(float));
+	ok = fsync(fd) == 0 && ok;
+	::close(fd);
+
+	if (!ok || rename(tmpName.c_str(), fileName) != 0) {
+		printf("Could not write %s\n", fileName);
+		unlink(tmpName.c_str());
+		return -1;
+	}
+	return 0;
+}
+
+float compareBackground(const uint16_t* depth, const int16_t* background, const float* stddev, uint16_t invalidDepth,
+		int touchDepthMin, int touchDepthMax, float noiseFactor, const uint64_t* area, int n) {
+	int known = 0, compared = 0, changed = 0;
+	for (int i = 0; i < n; i++) {
+		if (area && !((area[i / 64] >> (i % 64)) & 1)) {
+			continue;
+		}
+		int d = depth[i];
+		int b = background[i];
+		known += b != 0;
+		if (d == 0 || d == invalidDepth || b == 0) {
+			continue;
+		}
+		int lower = (int)ceilf(noiseFactor * stddev[i]);
+		if (lower < touchDepthMin) {
+			lower = touchDepthMin;
+		}
+		int tolerance = touchDepthMax + lower - touchDepthMin;
+		compared++;
+		changed += (d - b > tolerance) | (b - d > tolerance);
+	}
+	if (compared == 0 || compared < known / 2) {
+		return 1;
+	}
+	return (float)changed / compared;
+}
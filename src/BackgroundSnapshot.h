@@ -0,0 +1,77 @@
+//============================================================================
+// Name        : BackgroundSnapshot.h
+// Description : trained background and calibration saved for a warm start
+//============================================================================
+
+#ifndef INCLUDED_BackgroundSnapshot_H
+#define INCLUDED_BackgroundSnapshot_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * file layout:
+ *   SnapshotHeader
+ *   background, int16_t per pixel (at backgroundOffset)
+ *   standard deviation, float per pixel (at stddevOffset)
+ *
+ * little endian, arrays 16 byte aligned. the file is written to a
+ * temporary name and renamed, so a crash while saving never leaves a
+ * half written snapshot behind.
+ */
+
+#define SNAPSHOT_MAGIC "KTBACKG"
+#define SNAPSHOT_VERSION 1
+
+struct SnapshotHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;		// sizeof(SnapshotHeader)
+	uint32_t width, height;
+	uint32_t invalidDepth;		// DepthSensor::invalidDepth() of the sensor it was trained with
+	uint32_t trainedFrames;
+	int32_t roi[4];				// x, y, width, height
+	int32_t touchDepthMin, touchDepthMax;
+	float noiseFactor;
+	uint32_t backgroundOffset;
+	uint32_t stddevOffset;
+	uint32_t areaChecksum;		// ActiveArea::getChecksum() (0: unknown)
+	uint32_t reserved[14];
+};
+
+/*
+ * maps a snapshot read only. the arrays point into the mapping.
+ */
+class BackgroundSnapshot {
+public:
+	BackgroundSnapshot();
+	~BackgroundSnapshot();
+
+	int open(const char* fileName);
+	void close();
+
+	const SnapshotHeader& getHeader() const { return *header; }
+	const int16_t* getBackground() const { return (const int16_t*)(data + header->backgroundOffset); }
+	const float* getStdDev() const { return (const float*)(data + header->stddevOffset); }
+
+	// fills in magic, version, sizes and offsets of header and writes the snapshot
+	static int save(const char* fileName, SnapshotHeader& header, const int16_t* background, const float* stddev);
+
+private:
+	uint8_t* data;
+	size_t size;
+	const SnapshotHeader* header;
+};
+
+/*
+ * fraction of the pixels valid in both depth and background whose depth
+ * differs from the background by more than the touch band (touchDepthMax
+ * above the noise floor, see TouchDetector). only pixels set in area (one
+ * bit per pixel, see ActiveArea) are looked at, all if area is NULL.
+ * returns 1 if less than half of the pixels with a background can be
+ * compared.
+ */
+float compareBackground(const uint16_t* depth, const int16_t* background, const float* stddev, uint16_t invalidDepth,
+		int touchDepthMin, int touchDepthMax, float noiseFactor, const uint64_t* area, int n);
+
+#endif
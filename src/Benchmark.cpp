@@ -0,0 +1,354 @@
+//============================================================================
+// Name        : Benchmark.cpp
+// Description : micro benchmarks of the per frame processing (--benchmark)
+//============================================================================
+
+#include "Benchmark.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include <string>
+
+#include <opencv/cv.h>
+
+#include "SyntheticDepthSensor.h"
+#include "TouchKernels.h"
+#include "RunLabeller.h"
+#include "TouchDetector.h"
+#include "DepthConvert.h"
+
+using namespace std;
+using namespace cv;
+
+static const int frameWidth = 640;
+static const int frameHeight = 480;
+static const int touchDepthMin = 10;
+static const int touchDepthMax = 20;
+static const int repeat = 20;	// every frame is processed this often per measurement
+static const int adaptInterval = 4;	// frames between two background adaptions in benchmarkUnchanged, as in TouchSensor
+
+static double milliseconds(int64 ticks) {
+	return ticks * 1000.0 / getTickFrequency();
+}
+
+//---------------------------------------------------------------------------
+// threshold
+//---------------------------------------------------------------------------
+
+// the matrix expressions the main loop used to evaluate (temporaries for
+// the difference and both comparisons)
+static double thresholdExpression(const vector<Mat1s>& frames, const Mat1s& background, vector<Mat1b>& masks) {
+	int64 start = getTickCount();
+	for (int r = 0; r < repeat; r++) {
+		for (unsigned int i = 0; i < frames.size(); i++) {
+			Mat1s foreground = background - frames[i];
+			masks[i] = (foreground > touchDepthMin) & (foreground < touchDepthMax);
+		}
+	}
+	return milliseconds(getTickCount() - start) / (repeat * frames.size());
+}
+
+static double thresholdBitsKernel(ThresholdBitsFunc threshold, const vector<Mat1s>& frames, const Mat1s& near, const Mat1s& far, vector< vector<uint64_t> >& masks) {
+	int64 start = getTickCount();
+	for (int r = 0; r < repeat; r++) {
+		for (unsigned int i = 0; i < frames.size(); i++) {
+			threshold(frames[i][0], near[0], far[0], &masks[i][0], frameWidth * frameHeight / 64);
+		}
+	}
+	return milliseconds(getTickCount() - start) / (repeat * frames.size());
+}
+
+static bool sameMasks(const vector<Mat1b>& a, const vector< vector<uint64_t> >& b) {
+	vector<uint8_t> unpacked(frameWidth * frameHeight);
+	for (unsigned int i = 0; i < a.size(); i++) {
+		unpackMask(&b[i][0], &unpacked[0], frameWidth * frameHeight);
+		if (memcmp(a[i][0], &unpacked[0], frameWidth * frameHeight) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static int benchmarkThreshold(const vector<Mat1s>& frames, const Mat1s& near, const Mat1s& far, const Mat1s& background, vector<Mat1b>& reference) {
+	reference.resize(frames.size());
+	double referenceMs = thresholdExpression(frames, background, reference);
+	printf("threshold  %-10s %7.3f ms\n", "opencv", referenceMs);
+
+	static const char* names[] = { "scalar", "sse2", "avx2" };
+	int failed = 0;
+	for (unsigned int k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+		ThresholdBitsFunc threshold = getThresholdBandBits(names[k]);
+		if (!threshold) {
+			printf("threshold  %-10s not supported by this cpu\n", names[k]);
+			continue;
+		}
+		vector< vector<uint64_t> > masks(frames.size(), vector<uint64_t>(frameWidth * frameHeight / 64));
+		double ms = thresholdBitsKernel(threshold, frames, near, far, masks);
+		bool same = sameMasks(reference, masks);
+		printf("threshold  %-10s %7.3f ms  %5.1fx%s\n", (string(names[k]) + " bits").c_str(), ms, referenceMs / ms, same ? "" : "  MISMATCH");
+		failed |= !same;
+	}
+	return failed;
+}
+
+//---------------------------------------------------------------------------
+// blob extraction
+//---------------------------------------------------------------------------
+
+// contours of the byte mask, the way the touch points used to be found
+static double labelContours(const vector<Mat1b>& masks, unsigned int& blobs) {
+	vector< vector<Point2i> > contours;
+	blobs = 0;
+	int64 start = getTickCount();
+	for (int r = 0; r < repeat; r++) {
+		for (unsigned int i = 0; i < masks.size(); i++) {
+			Mat1b mask = masks[i].clone();	// findContours modifies its input
+			contours.clear();
+			findContours(mask, contours, CV_RETR_LIST, CV_CHAIN_APPROX_SIMPLE);
+			if (r == 0) {
+				blobs += contours.size();
+			}
+		}
+	}
+	return milliseconds(getTickCount() - start) / (repeat * masks.size());
+}
+
+static double labelRuns(const vector< vector<uint64_t> >& masks, unsigned int& blobs, unsigned int& runs) {
+	RunLabeller labeller;
+	blobs = runs = 0;
+	int64 start = getTickCount();
+	for (int r = 0; r < repeat; r++) {
+		for (unsigned int i = 0; i < masks.size(); i++) {
+			labeller.label(&masks[i][0], frameWidth / 64, 0, 0, frameWidth, frameHeight);
+			if (r == 0) {
+				blobs += labeller.getBlobs().size();
+				runs += labeller.getRuns().size();
+			}
+		}
+	}
+	return milliseconds(getTickCount() - start) / (repeat * masks.size());
+}
+
+static void benchmarkLabelling(const vector<Mat1s>& frames, const Mat1s& near, const Mat1s& far, const vector<Mat1b>& reference) {
+	vector< vector<uint64_t> > masks(frames.size(), vector<uint64_t>(frameWidth * frameHeight / 64));
+	for (unsigned int i = 0; i < frames.size(); i++) {
+		thresholdBandBits(frames[i][0], near[0], far[0], &masks[i][0], frameWidth * frameHeight / 64);
+	}
+
+	unsigned int contourBlobs, runBlobs, runs;
+	double contourMs = labelContours(reference, contourBlobs);
+	printf("labelling  %-10s %7.3f ms  %.1f blobs per frame\n", "contours", contourMs, (double)contourBlobs / frames.size());
+	double runMs = labelRuns(masks, runBlobs, runs);
+	printf("labelling  %-10s %7.3f ms  %5.1fx  %.1f blobs, %.0f runs per frame\n", "runs", runMs, contourMs / runMs,
+			(double)runBlobs / frames.size(), (double)runs / frames.size());
+}
+
+//---------------------------------------------------------------------------
+// opening of the mask before labelling
+//---------------------------------------------------------------------------
+
+static void benchmarkOpening(const vector<Mat1s>& frames, const Mat1s& near, const Mat1s& far) {
+	const int words = frameWidth * frameHeight / 64;
+	vector< vector<uint64_t> > masks(frames.size(), vector<uint64_t>(words));
+	for (unsigned int i = 0; i < frames.size(); i++) {
+		thresholdBandBits(frames[i][0], near[0], far[0], &masks[i][0], words);
+	}
+
+	unsigned int rawBlobs, rawRuns;
+	double rawMs = labelRuns(masks, rawBlobs, rawRuns);
+
+	vector<uint64_t> eroded(words);
+	int64 start = getTickCount();
+	for (int r = 0; r < repeat; r++) {
+		for (unsigned int i = 0; i < masks.size(); i++) {
+			vector<uint64_t> opened = masks[i];
+			morphMask(&opened[0], &eroded[0], frameWidth / 64, 0, 0, frameWidth, frameHeight, 0, frameHeight, false);
+			morphMask(&eroded[0], &opened[0], frameWidth / 64, 0, 0, frameWidth, frameHeight, 0, frameHeight, true);
+			if (r == repeat - 1) {
+				masks[i] = opened;
+			}
+		}
+	}
+	double openMs = milliseconds(getTickCount() - start) / (repeat * masks.size());
+
+	unsigned int openBlobs, openRuns;
+	double labelMs = labelRuns(masks, openBlobs, openRuns);
+	printf("opening    %-10s %7.3f ms\n", "3x3", openMs);
+	printf("labelling  %-10s %7.3f ms  %.1f blobs, %.0f runs per frame\n", "raw", rawMs,
+			(double)rawBlobs / frames.size(), (double)rawRuns / frames.size());
+	printf("labelling  %-10s %7.3f ms  %.1f blobs, %.0f runs per frame\n", "opened", labelMs,
+			(double)openBlobs / frames.size(), (double)openRuns / frames.size());
+}
+
+//---------------------------------------------------------------------------
+// whole segmentation, stripes on several threads
+//---------------------------------------------------------------------------
+
+static bool sameBlobs(const vector<MaskBlob>& a, const vector<MaskBlob>& b) {
+	if (a.size() != b.size()) {
+		return false;
+	}
+	for (unsigned int i = 0; i < a.size(); i++) {
+		const MaskBlob& p = a[i];
+		const MaskBlob& q = b[i];
+		if (p.area != q.area || p.x0 != q.x0 || p.y0 != q.y0 || p.x1 != q.x1 || p.y1 != q.y1
+				|| p.cx != q.cx || p.cy != q.cy || p.xx != q.xx || p.xy != q.xy || p.yy != q.yy
+				|| p.minDepth != q.minDepth || p.meanDepth != q.meanDepth || p.wx != q.wx || p.wy != q.wy) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// with opening, which needs the most synchronization between the stripes
+static int benchmarkThreads(const vector<Mat1s>& frames, const Mat1s& background) {
+	vector< vector<uint64_t> > valid(frames.size(), vector<uint64_t>(frameWidth * frameHeight / 64));
+	for (unsigned int i = 0; i < frames.size(); i++) {
+		buildValidMask((const uint16_t*)frames[i][0], 0, &valid[i][0], frameWidth * frameHeight);
+	}
+	Mat1f stddev(frameHeight, frameWidth, 0.0f);
+
+	int cores = sysconf(_SC_NPROCESSORS_ONLN);
+	vector< vector<MaskBlob> > reference(frames.size());
+	vector<Point2f> touchPoints;
+	double singleMs = 0;
+	int failed = 0;
+	for (int threads = 1; threads <= cores; threads *= 2) {
+		TouchDetector detector(frameWidth, frameHeight);
+		detector.touchDepthMin = touchDepthMin;
+		detector.touchDepthMax = touchDepthMax;
+		detector.setBackground(background, stddev);
+		detector.setThreads(threads);
+		detector.openMask = true;
+
+		bool same = true;
+		int64 start = getTickCount();
+		for (int r = 0; r < repeat; r++) {
+			for (unsigned int i = 0; i < frames.size(); i++) {
+				detector.detect(frames[i], &valid[i][0], touchPoints);
+				if (r > 0) {
+					continue;
+				}
+				if (threads == 1) {
+					reference[i] = detector.getTouchBlobs();
+				} else {
+					same &= sameBlobs(reference[i], detector.getTouchBlobs());
+				}
+			}
+		}
+		double ms = milliseconds(getTickCount() - start) / (repeat * frames.size());
+		if (threads == 1) {
+			singleMs = ms;
+		}
+		printf("segment    %2d %-7s %7.3f ms  %5.1fx%s\n", threads, threads > 1 ? "threads" : "thread", ms, singleMs / ms, same ? "" : "  MISMATCH");
+		failed |= !same;
+	}
+	return failed;
+}
+
+// skipUnchanged on the frames with hands and on an empty table (sensor
+// noise only), where the mask should hardly ever change. the background is
+// adapted every adaptInterval frames as in TouchSensor, so the bands drift
+// like they do in a running sensor. the touch points must be the same.
+static int benchmarkUnchanged(const vector<Mat1s>& frames, const vector<Mat1s>& emptyFrames, const Mat1s& background) {
+	Mat1f stddev(frameHeight, frameWidth, 0.0f);
+	const vector<Mat1s>* scenes[2] = { &frames, &emptyFrames };
+	const char* names[2] = { "hands", "empty" };
+	int failed = 0;
+	for (int scene = 0; scene < 2; scene++) {
+		const vector<Mat1s>& f = *scenes[scene];
+		if (f.empty()) {
+			continue;
+		}
+		vector< vector<uint64_t> > valid(f.size(), vector<uint64_t>(frameWidth * frameHeight / 64));
+		for (unsigned int i = 0; i < f.size(); i++) {
+			buildValidMask((const uint16_t*)f[i][0], 0, &valid[i][0], frameWidth * frameHeight);
+		}
+		double ms[2];
+		vector< vector<Point2f> > touchPoints[2];
+		for (int skip = 0; skip < 2; skip++) {
+			TouchDetector detector(frameWidth, frameHeight);
+			detector.touchDepthMin = touchDepthMin;
+			detector.touchDepthMax = touchDepthMax;
+			detector.setBackground(background.clone(), stddev);
+			detector.skipUnchanged = skip;
+			touchPoints[skip].resize(repeat * f.size());
+			int64 start = getTickCount();
+			for (int r = 0; r < repeat; r++) {
+				for (unsigned int i = 0; i < f.size(); i++) {
+					if (i % adaptInterval == 0) {
+						for (int y = 0; y < frameHeight; y++) {
+							detector.adaptBackground((const uint16_t*)f[i][0], 0, y, 0, frameWidth);
+						}
+					}
+					detector.detect(f[i], &valid[i][0], touchPoints[skip][r * f.size() + i]);
+				}
+			}
+			ms[skip] = milliseconds(getTickCount() - start) / (repeat * f.size());
+		}
+		bool same = touchPoints[0] == touchPoints[1];
+		printf("unchanged  %-10s %7.3f ms  %7.3f ms skipping unchanged masks, adapting every %d frames%s\n",
+				names[scene], ms[0], ms[1], adaptInterval, same ? "" : "  MISMATCH");
+		failed |= !same;
+	}
+	return failed;
+}
+
+//---------------------------------------------------------------------------
+// runBenchmark
+//---------------------------------------------------------------------------
+
+int runBenchmark(int frames) {
+	SyntheticDepthSensor sensor(false);
+	if (sensor.open("fingers=10,empty=1,frames=0") != 0) {
+		printf("benchmark: could not open the synthetic scene\n");
+		return 1;
+	}
+
+	// the first frame is the empty table, the others have hands on it
+	Mat1s background;
+	vector<Mat1s> depthFrames;
+	KinnectFrameInfo info;
+	while ((int)depthFrames.size() < frames && sensor.waitFrame(info, 1000) > 0) {
+		Mat1s depth(frameHeight, frameWidth, (short*)sensor.getDepthMap());
+		if (background.empty()) {
+			depth.copyTo(background);
+		} else {
+			depthFrames.push_back(depth.clone());
+		}
+	}
+	sensor.close();
+	if (depthFrames.empty()) {
+		printf("benchmark: no frames\n");
+		return 1;
+	}
+
+	// the same table without hands
+	vector<Mat1s> emptyFrames;
+	SyntheticDepthSensor emptySensor(false);
+	if (emptySensor.open("fingers=10,empty=1000000,frames=0") == 0) {
+		while (emptyFrames.size() < depthFrames.size() && emptySensor.waitFrame(info, 1000) > 0) {
+			emptyFrames.push_back(Mat1s(frameHeight, frameWidth, (short*)emptySensor.getDepthMap()).clone());
+		}
+		emptySensor.close();
+	}
+
+	// bands of a noise free background, see TouchDetector::updateBands
+	Mat1s near(frameHeight, frameWidth), far(frameHeight, frameWidth);
+	for (int i = 0; i < frameWidth * frameHeight; i++) {
+		short b = background[0][i];
+		near[0][i] = b ? b - touchDepthMax : 0;
+		far[0][i] = b ? b - touchDepthMin : 0;
+	}
+
+	printf("benchmark: %d frames %dx%d, ms per frame\n", (int)depthFrames.size(), frameWidth, frameHeight);
+	vector<Mat1b> reference;
+	int failed = benchmarkThreshold(depthFrames, near, far, background, reference);
+	benchmarkLabelling(depthFrames, near, far, reference);
+	benchmarkOpening(depthFrames, near, far);
+	failed |= benchmarkThreads(depthFrames, background);
+	failed |= benchmarkUnchanged(depthFrames, emptyFrames, background);
+	return failed;
+}
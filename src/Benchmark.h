@@ -0,0 +1,16 @@
+//============================================================================
+// Name        : Benchmark.h
+// Description : micro benchmarks of the per frame processing (--benchmark)
+//============================================================================
+
+#ifndef INCLUDED_Benchmark_H
+#define INCLUDED_Benchmark_H
+
+/*
+ * renders frames with SyntheticDepthSensor and times the segmentation
+ * stages on them, every implementation against the reference. returns
+ * nonzero if an implementation gives a different result.
+ */
+int runBenchmark(int frames);
+
+#endif
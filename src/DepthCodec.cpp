@@ -0,0 +1,220 @@
+//============================================================================
+// Name        : DepthCodec.cpp
+// Description : lossless compression of 16 bit depth frames
+//============================================================================
+
+#include "DepthCodec.h"
+
+/*
+ * residuals are zigzag mapped (0, -1, 1, -2, ...) and written as
+ * unary(z >> k) + k low bits. k follows the mean residual of the row
+ * (reset at every row start so rows do not depend on stale statistics).
+ * quotients of escapeLimit or more are written as escapeLimit ones
+ * followed by the full 17 bit value, which bounds the code length.
+ */
+
+static const int escapeLimit = 24;
+static const int escapeBits = 17;	// zigzag of a difference of two uint16_t
+
+// bit writer, lsb first
+struct BitWriter {
+	uint8_t* out;
+	uint64_t acc;
+	int bits;
+
+	BitWriter(uint8_t* out) : out(out), acc(0), bits(0) {}
+
+	inline void put(uint32_t value, int n) {
+		acc |= (uint64_t)value << bits;
+		bits += n;
+		while (bits >= 8) {
+			*out++ = (uint8_t)acc;
+			acc >>= 8;
+			bits -= 8;
+		}
+	}
+
+	inline void ones(int n) {
+		while (n > 16) {
+			put(0xffff, 16);
+			n -= 16;
+		}
+		put((1u << n) - 1, n);
+	}
+
+	inline void flush() {
+		if (bits > 0) {
+			*out++ = (uint8_t)acc;
+		}
+		acc = 0;
+		bits = 0;
+	}
+};
+
+// bit reader, lsb first. reads past the end as zero bytes.
+struct BitReader {
+	const uint8_t* in;
+	const uint8_t* end;
+	uint64_t acc;
+	int bits;
+	int padding;	// zero bytes appended after the end
+
+	BitReader(const uint8_t* in, size_t size) : in(in), end(in + size), acc(0), bits(0), padding(0) {}
+
+	inline void refill() {
+		while (bits <= 56) {
+			uint64_t b = 0;
+			if (in < end) {
+				b = *in++;
+			} else {
+				padding++;
+			}
+			acc |= b << bits;
+			bits += 8;
+		}
+	}
+
+	// true if bits after the end of the input were consumed
+	inline bool overrun() const {
+		return bits < padding * 8;
+	}
+
+	inline uint32_t get(int n) {
+		if (bits < n) {
+			refill();
+		}
+		uint32_t value = (uint32_t)acc & ((1u << n) - 1);
+		acc >>= n;
+		bits -= n;
+		return value;
+	}
+
+	// number of one bits before the next zero (consumes the zero), at most limit
+	inline int unary(int limit) {
+		if (bits < 32) {
+			refill();
+		}
+		int n = __builtin_ctzll(~acc);
+		if (n >= limit) {
+			acc >>= limit;
+			bits -= limit;
+			return limit;
+		}
+		acc >>= n + 1;
+		bits -= n + 1;
+		return n;
+	}
+};
+
+// median edge detector of LOCO-I
+static inline int predict(int a, int b, int c) {
+	int mx = a > b ? a : b;
+	int mn = a > b ? b : a;
+	if (c >= mx) {
+		return mn;
+	}
+	if (c <= mn) {
+		return mx;
+	}
+	return a + b - c;
+}
+
+static inline int riceParameter(uint32_t sum, uint32_t count) {
+	int k = 0;
+	while ((count << k) < sum && k < 16) {
+		k++;
+	}
+	return k;
+}
+
+size_t depthCodecMaxSize(int width, int height) {
+	return ((size_t)width * height * (escapeLimit + escapeBits) + 7) / 8 + 8;
+}
+
+size_t encodeDepth(const uint16_t* depth, int width, int height, uint8_t* out) {
+	BitWriter writer(out);
+
+	for (int y = 0; y < height; y++) {
+		const uint16_t* row = depth + y * width;
+		const uint16_t* up = y > 0 ? row - width : 0;
+		uint32_t sum = 4, count = 1;
+
+		for (int x = 0; x < width; x++) {
+			int pred;
+			if (y == 0) {
+				pred = x > 0 ? row[x-1] : 0;
+			} else if (x == 0) {
+				pred = up[0];
+			} else {
+				pred = predict(row[x-1], up[x], up[x-1]);
+			}
+			int r = (int)row[x] - pred;
+			uint32_t z = ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+
+			int k = riceParameter(sum, count);
+			uint32_t q = z >> k;
+			if (q < (uint32_t)escapeLimit) {
+				writer.ones(q);
+				writer.put(0, 1);
+				if (k > 0) {
+					writer.put(z & ((1u << k) - 1), k);
+				}
+			} else {
+				writer.ones(escapeLimit);
+				writer.put(z, escapeBits);
+			}
+
+			sum += z;
+			if (++count == 64) {
+				sum >>= 1;
+				count >>= 1;
+			}
+		}
+	}
+
+	writer.flush();
+	return writer.out - out;
+}
+
+bool decodeDepth(const uint8_t* in, size_t size, int width, int height, uint16_t* depth) {
+	BitReader reader(in, size);
+
+	for (int y = 0; y < height; y++) {
+		uint16_t* row = depth + y * width;
+		const uint16_t* up = y > 0 ? row - width : 0;
+		uint32_t sum = 4, count = 1;
+
+		for (int x = 0; x < width; x++) {
+			int pred;
+			if (y == 0) {
+				pred = x > 0 ? row[x-1] : 0;
+			} else if (x == 0) {
+				pred = up[0];
+			} else {
+				pred = predict(row[x-1], up[x], up[x-1]);
+			}
+
+			int k = riceParameter(sum, count);
+			uint32_t z;
+			int q = reader.unary(escapeLimit);
+			if (q < escapeLimit) {
+				z = ((uint32_t)q << k) | (k > 0 ? reader.get(k) : 0);
+			} else {
+				z = reader.get(escapeBits);
+			}
+			int r = (int)(z >> 1) ^ -(int)(z & 1);
+			row[x] = (uint16_t)(pred + r);
+
+			sum += z;
+			if (++count == 64) {
+				sum >>= 1;
+				count >>= 1;
+			}
+		}
+
+		if (reader.overrun()) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,29 @@
+//============================================================================
+// Name        : DepthCodec.h
+// Description : lossless compression of 16 bit depth frames
+//============================================================================
+
+#ifndef INCLUDED_DepthCodec_H
+#define INCLUDED_DepthCodec_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * every pixel is predicted from its left, upper and upper left neighbours
+ * (the LOCO-I median predictor, i.e. row delta with an edge check) and the
+ * residual is written with an adaptive Rice code. the flat, slightly noisy
+ * table background ends up at 2-4 bits per pixel. every frame is coded on
+ * its own, so recordings stay seekable.
+ */
+
+// upper bound of the compressed size of a width x height frame
+size_t depthCodecMaxSize(int width, int height);
+
+// compresses a frame into out (at least depthCodecMaxSize bytes), returns the compressed size
+size_t encodeDepth(const uint16_t* depth, int width, int height, uint8_t* out);
+
+// decompresses a frame, returns false if the data is corrupt
+bool decodeDepth(const uint8_t* in, size_t size, int width, int height, uint16_t* depth);
+
+#endif
@@ -0,0 +1,225 @@
+//============================================================================
+// Name        : DepthConvert.cpp
+// Description : conversion kernels for raw kinect depth frames
+//============================================================================
+
+#include "DepthConvert.h"
+
+#include <stddef.h>
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define DEPTH_X86_SIMD
+#include <immintrin.h>
+#endif
+
+//---------------------------------------------------------------------------
+// disparity -> millimeters
+//---------------------------------------------------------------------------
+
+void initDisparityToMillimeters(uint16_t lut[2048]) {
+	for (int i = 0; i < 2048; i++) {
+		// approximation by stephane magnenat, see openkinect.org/wiki/Imaging_Information
+		double mm = 1000.0 * 0.1236 * tan(i / 2842.5 + 1.1863);
+		lut[i] = (i < 2047 && mm > 0 && mm <= 10000) ? (uint16_t)(mm + 0.5) : 0;
+	}
+}
+
+void convertDepth11(const uint16_t* raw, const uint16_t* lut, uint16_t* depth, int n) {
+	for (int i = 0; i < n; i++) {
+		depth[i] = lut[raw[i] & 2047];
+	}
+}
+
+//---------------------------------------------------------------------------
+// 11 bit packed -> 16 bit
+//---------------------------------------------------------------------------
+
+// 8 pixels in 11 bytes, most significant bit first
+static inline void unpackGroup(const uint8_t* b, uint16_t* d) {
+	d[0] = (b[0] << 3) | (b[1] >> 5);
+	d[1] = ((b[1] & 0x1f) << 6) | (b[2] >> 2);
+	d[2] = ((b[2] & 0x03) << 9) | (b[3] << 1) | (b[4] >> 7);
+	d[3] = ((b[4] & 0x7f) << 4) | (b[5] >> 4);
+	d[4] = ((b[5] & 0x0f) << 7) | (b[6] >> 1);
+	d[5] = ((b[6] & 0x01) << 10) | (b[7] << 2) | (b[8] >> 6);
+	d[6] = ((b[8] & 0x3f) << 5) | (b[9] >> 3);
+	d[7] = ((b[9] & 0x07) << 8) | b[10];
+}
+
+static inline void lookupGroup(const uint16_t* lut, uint16_t* d, int len) {
+	for (int j = 0; j < len; j++) {
+		d[j] = lut[d[j]];
+	}
+}
+
+static void unpackScalar(const uint8_t* packed, const uint16_t* lut, uint16_t* depth, int from, int n) {
+	for (int i = from; i < n; i += 8) {
+		unpackGroup(packed + i / 8 * 11, depth + i);
+		if (lut) {
+			lookupGroup(lut, depth + i, 8);
+		}
+	}
+}
+
+#ifdef DEPTH_X86_SIMD
+/*
+ * pixel i of a group starts at bit 11*i, i.e. in byte k = 11*i/8 at bit offset
+ * s = 11*i%8. the shuffle puts bytes k,k+1 into a 16 bit lane a (big endian)
+ * and byte k+2 into lane b. then
+ *   pixel = ((a << s) & 0xffff) >> 5 | (b << s+3) >> 16
+ * where both shifts are done as 16 bit multiplications by per lane constants.
+ * b only contributes for s > 5 (pixels 2 and 5), its lane is zero otherwise.
+ * the lut (if any) is applied on the just stored pixels while they are still
+ * in L1.
+ */
+#define UNPACK_SHUFFLE_A 1, 0, 2, 1, 3, 2, 5, 4, 6, 5, 7, 6, 9, 8, 10, 9
+#define UNPACK_SHUFFLE_B -1, -1, -1, -1, 4, -1, -1, -1, -1, -1, 8, -1, -1, -1, -1, -1
+#define UNPACK_MUL_A 1, 8, 64, 2, 16, 128, 4, 32
+#define UNPACK_MUL_B 0, 0, 512, 0, 0, 1024, 0, 0
+
+__attribute__((target("ssse3")))
+static void unpackSSSE3(const uint8_t* packed, const uint16_t* lut, uint16_t* depth, int n) {
+	const __m128i shufA = _mm_setr_epi8(UNPACK_SHUFFLE_A);
+	const __m128i shufB = _mm_setr_epi8(UNPACK_SHUFFLE_B);
+	const __m128i mulA = _mm_setr_epi16(UNPACK_MUL_A);
+	const __m128i mulB = _mm_setr_epi16(UNPACK_MUL_B);
+
+	// 16 byte loads: stop while at least 16 bytes are left to read
+	int i = 0;
+	for (; i + 16 <= n; i += 8) {
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(packed + i / 8 * 11));
+		__m128i a = _mm_shuffle_epi8(bytes, shufA);
+		__m128i b = _mm_shuffle_epi8(bytes, shufB);
+		__m128i d = _mm_or_si128(_mm_srli_epi16(_mm_mullo_epi16(a, mulA), 5), _mm_mulhi_epu16(b, mulB));
+		_mm_storeu_si128((__m128i*)(depth + i), d);
+		if (lut) {
+			lookupGroup(lut, depth + i, 8);
+		}
+	}
+	unpackScalar(packed, lut, depth, i, n);
+}
+
+__attribute__((target("avx2")))
+static void unpackAVX2(const uint8_t* packed, const uint16_t* lut, uint16_t* depth, int n) {
+	const __m256i shufA = _mm256_setr_epi8(UNPACK_SHUFFLE_A, UNPACK_SHUFFLE_A);
+	const __m256i shufB = _mm256_setr_epi8(UNPACK_SHUFFLE_B, UNPACK_SHUFFLE_B);
+	const __m256i mulA = _mm256_setr_epi16(UNPACK_MUL_A, UNPACK_MUL_A);
+	const __m256i mulB = _mm256_setr_epi16(UNPACK_MUL_B, UNPACK_MUL_B);
+
+	// two groups per iteration, one in each 128 bit lane. the second load
+	// reads up to byte 27, so keep three groups in reserve for the tail.
+	int i = 0;
+	for (; i + 24 <= n; i += 16) {
+		const uint8_t* p = packed + i / 8 * 11;
+		__m256i bytes = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)p)),
+				_mm_loadu_si128((const __m128i*)(p + 11)), 1);
+		__m256i a = _mm256_shuffle_epi8(bytes, shufA);
+		__m256i b = _mm256_shuffle_epi8(bytes, shufB);
+		__m256i d = _mm256_or_si256(_mm256_srli_epi16(_mm256_mullo_epi16(a, mulA), 5), _mm256_mulhi_epu16(b, mulB));
+		_mm256_storeu_si256((__m256i*)(depth + i), d);
+		if (lut) {
+			lookupGroup(lut, depth + i, 16);
+		}
+	}
+	unpackScalar(packed, lut, depth, i, n);
+}
+#endif
+
+typedef void (*UnpackFunc)(const uint8_t*, const uint16_t*, uint16_t*, int);
+
+static void unpackPlain(const uint8_t* packed, const uint16_t* lut, uint16_t* depth, int n) {
+	unpackScalar(packed, lut, depth, 0, n);
+}
+
+static UnpackFunc selectUnpack() {
+#ifdef DEPTH_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return unpackAVX2;
+	if (__builtin_cpu_supports("ssse3")) return unpackSSSE3;
+#endif
+	return unpackPlain;
+}
+
+static const UnpackFunc unpack = selectUnpack();
+
+void unpackDepth11(const uint8_t* packed, const uint16_t* lut, uint16_t* depth, int n) {
+	unpack(packed, lut, depth, n);
+}
+
+//---------------------------------------------------------------------------
+// validity mask
+//---------------------------------------------------------------------------
+
+static void validMaskScalar(const uint16_t* depth, uint16_t invalid, uint64_t* mask, int from, int n) {
+	for (int i = from; i < n; i += 64) {
+		uint64_t m = 0;
+		for (int j = 0; j < 64; j++) {
+			uint16_t d = depth[i + j];
+			m |= (uint64_t)((d != 0) & (d != invalid)) << j;
+		}
+		mask[i / 64] = m;
+	}
+}
+
+#ifdef DEPTH_X86_SIMD
+__attribute__((target("sse2")))
+static void validMaskSSE2(const uint16_t* depth, uint16_t invalid, uint64_t* mask, int n) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i invalidValue = _mm_set1_epi16(invalid);
+	for (int i = 0; i < n; i += 64) {
+		uint64_t m = 0;
+		for (int j = 0; j < 64; j += 16) {
+			__m128i d0 = _mm_loadu_si128((const __m128i*)(depth + i + j));
+			__m128i d1 = _mm_loadu_si128((const __m128i*)(depth + i + j + 8));
+			__m128i bad0 = _mm_or_si128(_mm_cmpeq_epi16(d0, zero), _mm_cmpeq_epi16(d0, invalidValue));
+			__m128i bad1 = _mm_or_si128(_mm_cmpeq_epi16(d1, zero), _mm_cmpeq_epi16(d1, invalidValue));
+			// one byte per pixel, one bit per byte
+			uint32_t bad = _mm_movemask_epi8(_mm_packs_epi16(bad0, bad1));
+			m |= (uint64_t)(~bad & 0xffff) << j;
+		}
+		mask[i / 64] = m;
+	}
+}
+
+__attribute__((target("avx2")))
+static void validMaskAVX2(const uint16_t* depth, uint16_t invalid, uint64_t* mask, int n) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i invalidValue = _mm256_set1_epi16(invalid);
+	for (int i = 0; i < n; i += 64) {
+		uint64_t m = 0;
+		for (int j = 0; j < 64; j += 32) {
+			__m256i d0 = _mm256_loadu_si256((const __m256i*)(depth + i + j));
+			__m256i d1 = _mm256_loadu_si256((const __m256i*)(depth + i + j + 16));
+			__m256i bad0 = _mm256_or_si256(_mm256_cmpeq_epi16(d0, zero), _mm256_cmpeq_epi16(d0, invalidValue));
+			__m256i bad1 = _mm256_or_si256(_mm256_cmpeq_epi16(d1, zero), _mm256_cmpeq_epi16(d1, invalidValue));
+			// packs works per 128 bit lane, restore the pixel order
+			__m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(bad0, bad1), 0xd8);
+			uint32_t bad = _mm256_movemask_epi8(packed);
+			m |= (uint64_t)~bad << j;
+		}
+		mask[i / 64] = m;
+	}
+}
+#endif
+
+typedef void (*ValidMaskFunc)(const uint16_t*, uint16_t, uint64_t*, int);
+
+static void validMaskPlain(const uint16_t* depth, uint16_t invalid, uint64_t* mask, int n) {
+	validMaskScalar(depth, invalid, mask, 0, n);
+}
+
+static ValidMaskFunc selectValidMask() {
+#ifdef DEPTH_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return validMaskAVX2;
+	if (__builtin_cpu_supports("sse2")) return validMaskSSE2;
+#endif
+	return validMaskPlain;
+}
+
+static const ValidMaskFunc validMask = selectValidMask();
+
+void buildValidMask(const uint16_t* depth, uint16_t invalidDepth, uint64_t* mask, int n) {
+	validMask(depth, invalidDepth, mask, n);
+}
@@ -0,0 +1,42 @@
+//============================================================================
+// Name        : DepthConvert.h
+// Description : conversion kernels for raw kinect depth frames
+//============================================================================
+
+#ifndef INCLUDED_DepthConvert_H
+#define INCLUDED_DepthConvert_H
+
+#include <stdint.h>
+
+// size in bytes of a 640x480 FREENECT_DEPTH_11BIT_PACKED frame
+#define DEPTH_11BIT_PACKED_SIZE (640*480*11/8)
+
+/*
+ * fills lut with the distance in millimeters for each raw 11 bit disparity
+ * value. values without a valid reading (2047 and everything beyond the
+ * range of the sensor) map to FREENECT_DEPTH_MM_NO_VALUE (0).
+ */
+void initDisparityToMillimeters(uint16_t lut[2048]);
+
+/*
+ * converts n raw 11 bit disparity values to millimeters
+ */
+void convertDepth11(const uint16_t* raw, const uint16_t* lut, uint16_t* depth, int n);
+
+/*
+ * unpacks n pixels (n a multiple of 8) of FREENECT_DEPTH_11BIT_PACKED data
+ * (big endian bit stream, 8 pixels in 11 bytes) into one uint16_t per pixel.
+ * if lut is not NULL it is applied to every pixel while unpacking.
+ * uses AVX2 or SSSE3 when the cpu supports it.
+ */
+void unpackDepth11(const uint8_t* packed, const uint16_t* lut, uint16_t* depth, int n);
+
+/*
+ * sets bit i % 64 of mask[i / 64] for every pixel i with a reading (not 0
+ * and not invalidDepth), n must be a multiple of 64. the mask is built
+ * once per frame and lets later stages skip pixels without a reading
+ * 64 at a time. uses AVX2 or SSE2 when the cpu supports it.
+ */
+void buildValidMask(const uint16_t* depth, uint16_t invalidDepth, uint64_t* mask, int n);
+
+#endif
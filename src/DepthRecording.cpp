@@ -0,0 +1,386 @@
+//============================================================================
+// Name        : DepthRecording.cpp
+// Description : file format for recorded depth streams
+//============================================================================
+
+#include "DepthRecording.h"
+#include "DepthCodec.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+using namespace std;
+
+static const uint32_t frameBytes = 640*480*sizeof(uint16_t);
+
+static bool writeAll(int fd, const void* buf, size_t len) {
+	const char* p = (const char*)buf;
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------
+// DepthRecorder
+//---------------------------------------------------------------------------
+
+DepthRecorder::DepthRecorder(RecordingEncoding encoding, unsigned int queueSize)
+	: encoding(encoding)
+	, queueSize(queueSize)
+	, fd(-1)
+	, offset(0)
+	, bytesIn(0)
+	, bytesOut(0)
+	, die(0)
+	, failed(false)
+	, dropped(0)
+{
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&queueCond, NULL);
+}
+
+DepthRecorder::~DepthRecorder() {
+	close();
+	pthread_cond_destroy(&queueCond);
+	pthread_mutex_destroy(&mutex);
+}
+
+int DepthRecorder::open(const char* fileName, RecordingDepthFormat depthFormat, const int roi[4], const float surface[4]) {
+	fd = ::open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		printf("Could not create %s\n", fileName);
+		return -1;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+	header.version = RECORDING_VERSION;
+	header.headerSize = sizeof(RecordingHeader);
+	header.width = 640;
+	header.height = 480;
+	header.depthFormat = depthFormat;
+	memcpy(header.roi, roi, sizeof(header.roi));
+	memcpy(header.surface, surface, sizeof(header.surface));
+
+	if (!writeAll(fd, &header, sizeof(header))) {
+		printf("Could not write %s\n", fileName);
+		::close(fd);
+		fd = -1;
+		return -1;
+	}
+	offset = sizeof(header);
+	index.clear();
+	bytesIn = bytesOut = 0;
+	failed = false;
+	dropped = 0;
+
+	if (encoding != RECORDING_ENCODING_RAW) {
+		encoded.resize(depthCodecMaxSize(header.width, header.height));
+	}
+	for (unsigned int i = 0; i < queueSize; i++) {
+		freeBuffers.push_back(new uint16_t[640*480]);
+	}
+
+	die = 0;
+	if (pthread_create(&thread, NULL, threadFunc, this)) {
+		printf("pthread_create failed\n");
+		::close(fd);
+		fd = -1;
+		for (unsigned int i = 0; i < freeBuffers.size(); i++) {
+			delete[] freeBuffers[i];
+		}
+		freeBuffers.clear();
+		return -1;
+	}
+	return 0;
+}
+
+int DepthRecorder::append(const uint16_t* depth, const KinnectFrameInfo& info) {
+	if (fd < 0 || failed) {
+		return -1;
+	}
+
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+
+	pthread_mutex_lock(&mutex);
+	if (freeBuffers.empty()) {
+		// writer is behind, keep the capture going
+		dropped++;
+		pthread_mutex_unlock(&mutex);
+		return -1;
+	}
+	QueuedFrame queued;
+	queued.pixels = freeBuffers.back();
+	freeBuffers.pop_back();
+	pthread_mutex_unlock(&mutex);
+
+	memset(&queued.frame, 0, sizeof(queued.frame));
+	queued.frame.sequence = info.sequence;
+	queued.frame.timestamp = info.timestamp;
+	queued.frame.time = (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+	memcpy(queued.pixels, depth, frameBytes);
+
+	pthread_mutex_lock(&mutex);
+	queue.push_back(queued);
+	pthread_cond_signal(&queueCond);
+	pthread_mutex_unlock(&mutex);
+	return 0;
+}
+
+void *DepthRecorder::threadFunc(void *arg) {
+	((DepthRecorder*)arg)->run();
+	return NULL;
+}
+
+void DepthRecorder::run() {
+	pthread_mutex_lock(&mutex);
+	for (;;) {
+		while (queue.empty() && die == 0) {
+			pthread_cond_wait(&queueCond, &mutex);
+		}
+		if (queue.empty()) {
+			break;	// drained after close()
+		}
+		QueuedFrame queued = queue.front();
+		queue.pop_front();
+		pthread_mutex_unlock(&mutex);
+
+		if (!failed && !writeFrame(queued)) {
+			printf("Could not write frame %u, recording stopped\n", queued.frame.sequence);
+			failed = true;
+		}
+
+		pthread_mutex_lock(&mutex);
+		freeBuffers.push_back(queued.pixels);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+bool DepthRecorder::writeFrame(QueuedFrame& queued) {
+	static const uint8_t padding[16] = { 0 };
+
+	const void* pixels = queued.pixels;
+	queued.frame.size = frameBytes;
+	queued.frame.encoding = encoding;
+	if (encoding == RECORDING_ENCODING_RICE) {
+		queued.frame.size = encodeDepth(queued.pixels, header.width, header.height, &encoded[0]);
+		pixels = &encoded[0];
+	}
+	uint32_t padded = (queued.frame.size + 15) & ~15u;
+
+	if (!writeAll(fd, &queued.frame, sizeof(queued.frame)) || !writeAll(fd, pixels, queued.frame.size)
+			|| !writeAll(fd, padding, padded - queued.frame.size)) {
+		return false;
+	}
+
+	RecordingIndexEntry entry;
+	entry.offset = offset;
+	entry.time = queued.frame.time;
+	entry.sequence = queued.frame.sequence;
+	entry.timestamp = queued.frame.timestamp;
+	index.push_back(entry);
+
+	offset += sizeof(queued.frame) + padded;
+	bytesIn += frameBytes;
+	bytesOut += queued.frame.size;
+	return true;
+}
+
+void DepthRecorder::close() {
+	if (fd < 0) {
+		return;
+	}
+
+	// let the writer drain the queue
+	pthread_mutex_lock(&mutex);
+	die = 1;
+	pthread_cond_signal(&queueCond);
+	pthread_mutex_unlock(&mutex);
+	pthread_join(thread, NULL);
+
+	if (index.empty() || writeAll(fd, &index[0], index.size() * sizeof(RecordingIndexEntry))) {
+		header.frameCount = index.size();
+		header.indexOffset = offset;
+		pwrite(fd, &header, sizeof(header), 0);
+	}
+	::close(fd);
+	fd = -1;
+
+	printf("recorded %u frames", (unsigned int)index.size());
+	if (bytesOut > 0 && encoding != RECORDING_ENCODING_RAW) {
+		printf(", compression %.1f:1", (double)bytesIn / bytesOut);
+	}
+	if (dropped > 0) {
+		printf(", %u frames dropped (writer too slow)", dropped);
+	}
+	printf("\n");
+
+	for (unsigned int i = 0; i < freeBuffers.size(); i++) {
+		delete[] freeBuffers[i];
+	}
+	freeBuffers.clear();
+}
+
+//---------------------------------------------------------------------------
+// DepthPlayer
+//---------------------------------------------------------------------------
+
+DepthPlayer::DepthPlayer()
+	: data(NULL)
+	, size(0)
+{
+}
+
+DepthPlayer::~DepthPlayer() {
+	close();
+}
+
+int DepthPlayer::open(const char* fileName) {
+	int fd = ::open(fileName, O_RDONLY);
+	if (fd < 0) {
+		printf("Could not open %s\n", fileName);
+		return -1;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		printf("Could not read %s\n", fileName);
+		::close(fd);
+		return -1;
+	}
+	size = st.st_size;
+
+	// private writable mapping: consumers may modify frames without touching the file
+	void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED) {
+		printf("Could not map %s\n", fileName);
+		return -1;
+	}
+	data = (uint8_t*)p;
+
+	index.clear();
+	if (size >= sizeof(RecordingHeader) && memcmp(data, RECORDING_MAGIC, sizeof(RECORDING_MAGIC)) == 0) {
+		memcpy(&header, data, sizeof(header));
+		if (header.version != RECORDING_VERSION) {
+			printf("%s: unsupported recording version %u\n", fileName, header.version);
+			close();
+			return -1;
+		}
+		// frames are handed out as 640x480, see DepthSensor
+		if (header.headerSize < sizeof(RecordingHeader) || header.width != 640 || header.height != 480) {
+			printf("%s: unsupported recording header (%ux%u frames)\n", fileName, header.width, header.height);
+			close();
+			return -1;
+		}
+		if (!readIndex()) {
+			printf("%s: no index, scanning frames\n", fileName);
+			rebuildIndex();
+		}
+	} else {
+		// headerless file of raw frames in millimeters at 30 fps
+		memset(&header, 0, sizeof(header));
+		header.width = 640;
+		header.height = 480;
+		header.depthFormat = RECORDING_DEPTH_MM;
+		for (size_t offset = 0; offset + frameBytes <= size; offset += frameBytes) {
+			RecordingIndexEntry entry;
+			entry.offset = offset;
+			entry.sequence = index.size() + 1;
+			entry.time = (uint64_t)index.size() * 1000000 / 30;
+			entry.timestamp = (uint32_t)entry.time;
+			index.push_back(entry);
+		}
+	}
+
+	printf("%s: %u frames\n", fileName, getFrameCount());
+	return 0;
+}
+
+void DepthPlayer::close() {
+	if (data) {
+		munmap(data, size);
+		data = NULL;
+		size = 0;
+	}
+	index.clear();
+}
+
+// true if the frame header and pixels at offset lie inside the file and an
+// uncompressed frame has exactly the pixels of the header dimensions
+bool DepthPlayer::frameFits(uint64_t offset) const {
+	if (offset < header.headerSize || offset > size || size - offset < sizeof(RecordingFrame)) {
+		return false;
+	}
+	const RecordingFrame* frame = (const RecordingFrame*)(data + offset);
+	if (size - offset - sizeof(RecordingFrame) < frame->size) {
+		return false;
+	}
+	return frame->encoding != RECORDING_ENCODING_RAW || frame->size == header.width * header.height * sizeof(uint16_t);
+}
+
+// the index written by the recorder. false (and no index) if it is missing
+// or any entry points to a frame that does not fit, the frames are scanned then
+bool DepthPlayer::readIndex() {
+	if (header.indexOffset == 0 || header.indexOffset + (uint64_t)header.frameCount * sizeof(RecordingIndexEntry) > size) {
+		return false;
+	}
+	const RecordingIndexEntry* entries = (const RecordingIndexEntry*)(data + header.indexOffset);
+	for (unsigned int i = 0; i < header.frameCount; i++) {
+		if (!frameFits(entries[i].offset)) {
+			printf("index entry %u is corrupt\n", i);
+			return false;
+		}
+	}
+	index.assign(entries, entries + header.frameCount);
+	return true;
+}
+
+// stops at the first frame that does not fit (truncated or corrupt file)
+void DepthPlayer::rebuildIndex() {
+	uint64_t offset = header.headerSize;
+	while (frameFits(offset)) {
+		const RecordingFrame* frame = (const RecordingFrame*)(data + offset);
+		RecordingIndexEntry entry;
+		entry.offset = offset;
+		entry.time = frame->time;
+		entry.sequence = frame->sequence;
+		entry.timestamp = frame->timestamp;
+		index.push_back(entry);
+		offset += sizeof(RecordingFrame) + ((frame->size + 15) & ~15u);
+	}
+}
+
+uint16_t* DepthPlayer::getFrame(unsigned int i) {
+	if (header.headerSize == 0) {
+		return (uint16_t*)(data + index[i].offset);
+	}
+
+	const RecordingFrame* frame = (const RecordingFrame*)(data + index[i].offset);
+	uint8_t* pixels = data + index[i].offset + sizeof(RecordingFrame);
+	switch (frame->encoding) {
+	case RECORDING_ENCODING_RAW:
+		return (uint16_t*)pixels;
+	case RECORDING_ENCODING_RICE:
+		decoded.resize(header.width * header.height);
+		if (!decodeDepth(pixels, frame->size, header.width, header.height, &decoded[0])) {
+			printf("frame %u is corrupt\n", i);
+			return NULL;
+		}
+		return &decoded[0];
+	default:
+		printf("frame %u: unknown encoding %u\n", i, frame->encoding);
+		return NULL;
+	}
+}
@@ -0,0 +1,153 @@
+//============================================================================
+// Name        : DepthRecording.h
+// Description : file format for recorded depth streams
+//============================================================================
+
+#ifndef INCLUDED_DepthRecording_H
+#define INCLUDED_DepthRecording_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <pthread.h>
+
+#include "DepthSensor.h"
+
+/*
+ * file layout:
+ *   RecordingHeader
+ *   RecordingFrame + pixel data (padded to 16 bytes), one per frame
+ *   RecordingIndexEntry for every frame (written when the recording is closed)
+ *
+ * all structures are little endian. header and frame headers are multiples
+ * of 16 bytes and frame data is padded, so the pixel data of uncompressed
+ * frames stays 16 byte aligned in a mapped file.
+ * if the index is missing (recording was not closed) the player rebuilds it
+ * from the frame headers.
+ */
+
+#define RECORDING_MAGIC "KTDEPTH"
+#define RECORDING_VERSION 1
+
+enum RecordingDepthFormat {
+	RECORDING_DEPTH_MM = 0,		// millimeters
+	RECORDING_DEPTH_RAW11 = 1	// raw 11 bit disparities
+};
+
+enum RecordingEncoding {
+	RECORDING_ENCODING_RAW = 0,	// uint16_t per pixel
+	RECORDING_ENCODING_RICE = 1	// lossless, see DepthCodec.h
+};
+
+struct RecordingHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;		// sizeof(RecordingHeader)
+	uint32_t width, height;
+	uint32_t depthFormat;		// RecordingDepthFormat
+	uint32_t frameCount;		// entries in the index (0 until closed)
+	uint64_t indexOffset;		// 0 until closed
+	int32_t roi[4];				// calibration: x, y, width, height of the touch surface in the frame
+	float surface[4];			// calibration: x0, y0, x1, y1 of the shared surface covered by roi
+								// (both used again on replay, width 0: not set)
+	uint32_t reserved[14];
+};
+
+struct RecordingFrame {
+	uint32_t sequence;
+	uint32_t timestamp;			// device timestamp
+	uint64_t time;				// capture time in microseconds
+	uint32_t size;				// bytes of pixel data following this header (without padding)
+	uint32_t encoding;			// RecordingEncoding
+	uint32_t reserved[2];
+};
+
+struct RecordingIndexEntry {
+	uint64_t offset;			// file offset of the RecordingFrame
+	uint64_t time;
+	uint32_t sequence;
+	uint32_t timestamp;
+};
+
+/*
+ * appends frames to a recording. call close() to write the index.
+ * append() only copies the frame into a bounded queue; compression and
+ * file i/o run on a writer thread, so a slow disk never stalls the
+ * capture. if the queue is full the frame is left out of the recording
+ * and counted.
+ */
+class DepthRecorder {
+public:
+	DepthRecorder(RecordingEncoding encoding = RECORDING_ENCODING_RAW, unsigned int queueSize = 16);
+	~DepthRecorder();
+
+	int open(const char* fileName, RecordingDepthFormat depthFormat, const int roi[4], const float surface[4]);
+	int append(const uint16_t* depth, const KinnectFrameInfo& info);
+	void close();
+
+private:
+	struct QueuedFrame {
+		RecordingFrame frame;
+		uint16_t* pixels;
+	};
+
+	RecordingEncoding encoding;
+	unsigned int queueSize;
+
+	int fd;
+	uint64_t offset;
+	RecordingHeader header;
+	std::vector<RecordingIndexEntry> index;	// owned by the writer thread until close()
+	std::vector<uint8_t> encoded;
+	uint64_t bytesIn, bytesOut;
+
+	int die;
+	volatile bool failed;
+	unsigned int dropped;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t queueCond;
+	std::deque<QueuedFrame> queue;		// guarded by mutex
+	std::vector<uint16_t*> freeBuffers;	// guarded by mutex
+
+	static void *threadFunc(void *arg);
+	void run();
+	bool writeFrame(QueuedFrame& queued);
+};
+
+/*
+ * maps a recording (or a file of raw 640x480 frames without header) into
+ * memory. uncompressed frames are returned as pointers into the mapping,
+ * nothing is copied or parsed per frame. compressed frames are decoded on
+ * demand into a buffer owned by the player, which is valid until the next
+ * getFrame().
+ */
+class DepthPlayer {
+public:
+	DepthPlayer();
+	~DepthPlayer();
+
+	int open(const char* fileName);
+	void close();
+
+	unsigned int getFrameCount() const { return index.size(); }
+	const RecordingHeader& getHeader() const { return header; }
+	const RecordingIndexEntry& getEntry(unsigned int i) const { return index[i]; }
+
+	// pixels of frame i, NULL if the frame is corrupt
+	uint16_t* getFrame(unsigned int i);
+
+private:
+	uint8_t* data;
+	size_t size;
+	RecordingHeader header;
+	std::vector<RecordingIndexEntry> index;
+	std::vector<uint16_t> decoded;
+
+	bool readIndex();
+	void rebuildIndex();
+	bool frameFits(uint64_t offset) const;
+};
+
+#endif
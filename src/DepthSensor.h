@@ -0,0 +1,87 @@
+//============================================================================
+// Name        : DepthSensor.h
+// Description : interface of all depth frame sources (kinect, openNI, files)
+//============================================================================
+
+#ifndef INCLUDED_DepthSensor_H
+#define INCLUDED_DepthSensor_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ActiveArea.h"
+
+// per frame information filled in by waitFrame()
+struct KinnectFrameInfo {
+	unsigned int sequence;		// increases by one for every frame the sensor delivered
+	unsigned int timestamp;		// device timestamp of the frame
+	unsigned int skipped;		// frames delivered since the last update that were never processed
+};
+
+// a touch position (pixels) known by the source
+struct GroundTruthTouch {
+	float x, y;
+};
+
+/*
+ * a source of 640x480 16 bit depth frames in millimeters. the backend is
+ * chosen at startup, the capture and segmentation code only sees this class.
+ */
+class DepthSensor {
+public:
+	virtual ~DepthSensor() {}
+
+	// opens the sensor (camera serial, file name, ...) and starts capturing. returns 0 on success.
+	virtual int open(const char* serial) = 0;
+	virtual void close() = 0;
+
+	/*
+	 * blocks until a frame newer than the current one arrived (or timeoutMs
+	 * passed) and makes it the current one. returns 1 for a new frame, 0 on
+	 * timeout and -1 when the source has no more frames.
+	 */
+	virtual int waitFrame(KinnectFrameInfo& info, int timeoutMs) = 0;
+
+	// the current frame
+	virtual uint16_t* getDepthMap() = 0;
+
+	/*
+	 * validity mask of the frame returned by the last getDepthMap() (see
+	 * buildValidMask), or NULL. sources that convert every pixel while
+	 * fetching the frame emit it in that pass, for the others the consumer
+	 * builds it.
+	 */
+	virtual const uint64_t* getValidMask() { return NULL; }
+
+	/*
+	 * limits the per pixel work of fetching a frame to the words of area
+	 * (not owned, NULL: whole frame). pixels outside are 0 (no reading) in
+	 * frames of sources that convert them. call before capturing starts.
+	 */
+	virtual void setIngestArea(const ActiveArea* area) {}
+
+	// true if the frames hold raw 11 bit disparities instead of millimeters
+	virtual bool rawDisparities() const { return false; }
+
+	// depth value of pixels without a reading (besides 0)
+	virtual uint16_t invalidDepth() const { return 0; }
+
+	/*
+	 * synthetic sources know where the touches of the current frame are and
+	 * return true. real sensors return false.
+	 */
+	virtual bool getGroundTruth(std::vector<GroundTruthTouch>& touches) { return false; }
+
+	/*
+	 * called when nothing was in front of the surface for a while (idle
+	 * true) and when something appears again. sensors may show it or save
+	 * power, frames still have to be delivered at the full rate.
+	 */
+	virtual void setIdle(bool idle) {}
+
+	virtual const std::string& getSerial() const = 0;
+};
+
+#endif
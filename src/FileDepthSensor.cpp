@@ -0,0 +1,72 @@
+//============================================================================
+// Name        : FileDepthSensor.cpp
+// Description : replays recorded depth frames from a file
+//============================================================================
+
+#include "FileDepthSensor.h"
+
+#include <unistd.h>
+#include <sys/time.h>
+
+static double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+FileDepthSensor::FileDepthSensor(bool realtime, int loops)
+	: realtime(realtime)
+	, loops(loops)
+	, frame(NULL)
+	, position(0)
+	, sequence(0)
+	, loopStart(0)
+{
+}
+
+int FileDepthSensor::open(const char* name) {
+	if (player.open(name) != 0) {
+		return -1;
+	}
+	fileName = name;
+	position = 0;
+	return 0;
+}
+
+void FileDepthSensor::close() {
+	player.close();
+	frame = NULL;
+}
+
+int FileDepthSensor::waitFrame(KinnectFrameInfo& info, int timeoutMs) {
+	if (position == player.getFrameCount()) {
+		if (position == 0 || (loops > 0 && --loops == 0)) {
+			return -1;
+		}
+		position = 0;
+	}
+
+	const RecordingIndexEntry& entry = player.getEntry(position);
+	if (realtime) {
+		if (position == 0) {
+			loopStart = now();
+		}
+		double wait = loopStart + (entry.time - player.getEntry(0).time) * 1e-6 - now();
+		if (wait * 1000 > timeoutMs) {
+			usleep(timeoutMs * 1000);
+			return 0;
+		}
+		if (wait > 0) {
+			usleep((useconds_t)(wait * 1e6));
+		}
+	}
+
+	frame = player.getFrame(position++);
+	if (frame == NULL) {
+		return 0;	// corrupt frame, skip it
+	}
+	info.sequence = ++sequence;
+	info.timestamp = entry.timestamp;
+	info.skipped = 0;
+	return 1;
+}
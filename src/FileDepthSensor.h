@@ -0,0 +1,46 @@
+//============================================================================
+// Name        : FileDepthSensor.h
+// Description : replays recorded depth frames from a file
+//============================================================================
+
+#ifndef INCLUDED_FileDepthSensor_H
+#define INCLUDED_FileDepthSensor_H
+
+#include "DepthSensor.h"
+#include "DepthRecording.h"
+
+/*
+ * replays a recording (see DepthRecording.h). frames are delivered with
+ * their recorded timing, or as fast as the consumer fetches them when
+ * realtime is false, which measures the maximum throughput of the pipeline
+ * without a sensor. frames are handed out straight from the mapped file.
+ */
+class FileDepthSensor : public DepthSensor {
+public:
+	FileDepthSensor(bool realtime = true, int loops = 1);
+
+	// opens the file with the given name
+	int open(const char* fileName);
+	void close();
+
+	int waitFrame(KinnectFrameInfo& info, int timeoutMs);
+	uint16_t* getDepthMap() { return frame; }
+	bool rawDisparities() const { return getHeader().depthFormat == RECORDING_DEPTH_RAW11; }
+	uint16_t invalidDepth() const { return rawDisparities() ? 2047 : 0; }
+
+	const std::string& getSerial() const { return fileName; }
+	const RecordingHeader& getHeader() const { return player.getHeader(); }
+
+private:
+	bool realtime;
+	int loops;			// how often the file is played (0: forever)
+
+	std::string fileName;
+	DepthPlayer player;
+	uint16_t* frame;
+	unsigned int position;	// next frame in the file
+	unsigned int sequence;
+	double loopStart;		// wall time at which the first frame of this loop was delivered
+};
+
+#endif
@@ -0,0 +1,244 @@
+//============================================================================
+// Name        : KinectSensor.cpp
+// Description : depth capture from one kinect through libfreenect
+//============================================================================
+
+#include "KinectSensor.h"
+#include "DepthConvert.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <algorithm>
+
+using namespace std;
+
+KinectSensor::KinectSensor(freenect_depth_format format, bool convertMillimeters)
+	: format(format)
+	, convertMillimeters(convertMillimeters)
+	, die(0)
+	, idle(false)
+	, ctx(NULL)
+	, dev(NULL)
+	, validMask(640*480/64)
+	, ingestMask(false)
+	, ingestArea(NULL)
+	, gotDepth(0)
+	, midSequence(0)
+	, midTimestamp(0)
+	, frontSequence(0)
+{
+	buffers = new uint16_t[3 * 640*480];
+	back = buffers;
+	mid = buffers + 640*480;
+	front = buffers + 2 * 640*480;
+	ingest = new uint16_t[640*480];
+	initDisparityToMillimeters(toMillimeters);
+
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&frameCond, NULL);
+}
+
+KinectSensor::~KinectSensor() {
+	close();
+	pthread_cond_destroy(&frameCond);
+	pthread_mutex_destroy(&mutex);
+	delete[] ingest;
+	delete[] buffers;
+}
+
+int KinectSensor::listSerials(vector<string>& serials) {
+	freenect_context *ctx;
+	if (freenect_init(&ctx, NULL) < 0) {
+		printf("freenect_init() failed\n");
+		return -1;
+	}
+	freenect_select_subdevices(ctx, (freenect_device_flags)(FREENECT_DEVICE_CAMERA));
+
+	struct freenect_device_attributes *list;
+	int count = freenect_list_device_attributes(ctx, &list);
+	for (struct freenect_device_attributes *item = list; item != NULL; item = item->next) {
+		serials.push_back(item->camera_serial);
+	}
+	if (count > 0) {
+		freenect_free_device_attributes(list);
+	}
+
+	freenect_shutdown(ctx);
+	return count;
+}
+
+int KinectSensor::open(const char* cameraSerial) {
+	// setup
+	if (freenect_init(&ctx, NULL) < 0) {
+		printf("freenect_init() failed\n");
+		return -1;
+	}
+
+	freenect_set_log_level(ctx, FREENECT_LOG_WARNING);
+	freenect_select_subdevices(ctx, (freenect_device_flags)(FREENECT_DEVICE_CAMERA));
+
+	int res = cameraSerial ? freenect_open_device_by_camera_serial(ctx, &dev, cameraSerial) : freenect_open_device(ctx, &dev, 0);
+	if (res < 0) {
+		printf("Could not open device %s\n", cameraSerial ? cameraSerial : "0");
+		freenect_shutdown(ctx);
+		ctx = NULL;
+		return -1;
+	}
+	serial = cameraSerial ? cameraSerial : "0";
+	freenect_set_user(dev, this);
+
+	// depth読み取り用のスレッド起動
+	die = 0;
+	res = pthread_create(&thread, NULL, threadFunc, this);
+	if (res) {
+		printf("pthread_create failed\n");
+		freenect_close_device(dev);
+		freenect_shutdown(ctx);
+		dev = NULL;
+		ctx = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+void KinectSensor::close() {
+	if (ctx == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&mutex);
+	die = 1;
+	pthread_cond_broadcast(&frameCond);
+	pthread_mutex_unlock(&mutex);
+
+	pthread_join(thread, NULL);
+	ctx = NULL;
+	dev = NULL;
+}
+
+void KinectSensor::depthCallback(freenect_device *dev, void *v_depth, uint32_t timestamp) {
+	KinectSensor *sensor = (KinectSensor*)freenect_get_user(dev);
+
+	pthread_mutex_lock(&sensor->mutex);
+
+	// v_depth is back (set by freenect_set_depth_buffer), make it the
+	// newest frame and give the previous mid buffer back to the driver
+	sensor->back = sensor->mid;
+	freenect_set_depth_buffer(dev, sensor->back);
+	sensor->mid = (uint16_t*)v_depth;
+	sensor->midSequence++;
+	sensor->midTimestamp = timestamp;
+	sensor->gotDepth++;
+
+	pthread_cond_signal(&sensor->frameCond);
+	pthread_mutex_unlock(&sensor->mutex);
+}
+
+void *KinectSensor::threadFunc(void *arg) {
+	((KinectSensor*)arg)->run();
+	return NULL;
+}
+
+void KinectSensor::run() {
+	bool ledIdle = false;
+	freenect_set_led(dev, LED_RED);
+	freenect_set_depth_callback(dev, depthCallback);
+	freenect_set_depth_mode(dev, freenect_find_depth_mode(FREENECT_RESOLUTION_MEDIUM, format));
+	freenect_set_depth_buffer(dev, back);
+
+	freenect_start_depth(dev);
+
+	printf("starting capture of sensor %s\n", serial.c_str());
+
+	while (die == 0 && freenect_process_events(ctx) >= 0) {
+		// usb transfers of the device stay on this thread
+		if (idle != ledIdle) {
+			ledIdle = idle;
+			freenect_set_led(dev, ledIdle ? LED_GREEN : LED_RED);
+		}
+	}
+
+	printf("shutting down sensor %s...\n", serial.c_str());
+
+	freenect_stop_depth(dev);
+
+	freenect_close_device(dev);
+	freenect_shutdown(ctx);
+}
+
+int KinectSensor::waitFrame(KinnectFrameInfo& info, int timeoutMs) {
+	struct timeval now;
+	struct timespec deadline;
+	gettimeofday(&now, NULL);
+	deadline.tv_sec = now.tv_sec + timeoutMs / 1000;
+	deadline.tv_nsec = now.tv_usec * 1000 + (timeoutMs % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&mutex);
+	while (!gotDepth && die == 0) {
+		if (pthread_cond_timedwait(&frameCond, &mutex, &deadline) == ETIMEDOUT) {
+			break;
+		}
+	}
+	if (!gotDepth) {
+		pthread_mutex_unlock(&mutex);
+		return 0;
+	}
+
+	uint16_t *tmp = front;
+	front = mid;
+	mid = tmp;
+	gotDepth = 0;
+
+	info.skipped = midSequence - frontSequence - 1;
+	info.sequence = frontSequence = midSequence;
+	info.timestamp = midTimestamp;
+	pthread_mutex_unlock(&mutex);
+
+	return 1;
+}
+
+// the words outside the area are never written again
+void KinectSensor::setIngestArea(const ActiveArea* area) {
+	ingestArea = area;
+	memset(ingest, 0, 640*480*sizeof(uint16_t));
+	fill(validMask.begin(), validMask.end(), 0);
+}
+
+// frames that have to be unpacked or converted go through ingest one row at
+// a time, only the words covering the ingest area. the validity mask of a
+// row is built while it is still in L1. millimeter frames and raw
+// disparities are handed out without a pass.
+uint16_t* KinectSensor::getDepthMap() {
+	const uint16_t *lut = convertMillimeters ? toMillimeters : NULL;
+	ingestMask = format == FREENECT_DEPTH_11BIT_PACKED || (format == FREENECT_DEPTH_11BIT && lut);
+	if (!ingestMask) {
+		return front;
+	}
+	uint16_t invalid = invalidDepth();
+	for (int y = 0; y < 480; y++) {
+		int k0 = 0, k1 = 640 / 64;
+		if (ingestArea) {
+			ingestArea->getWordRange(y, k0, k1);
+		}
+		if (k0 == k1) {
+			continue;
+		}
+		uint16_t* row = ingest + y * 640 + k0 * 64;
+		int n = (k1 - k0) * 64;
+		if (format == FREENECT_DEPTH_11BIT_PACKED) {
+			// 64 pixels are 88 bytes
+			unpackDepth11((uint8_t*)front + (y * 640 + k0 * 64) * 11 / 8, lut, row, n);
+		} else {
+			convertDepth11(front + y * 640 + k0 * 64, lut, row, n);
+		}
+		buildValidMask(row, invalid, &validMask[y * 640 / 64 + k0], n);
+	}
+	return ingest;
+}
@@ -0,0 +1,87 @@
+//============================================================================
+// Name        : KinectSensor.h
+// Description : depth capture from one kinect through libfreenect
+//============================================================================
+
+#ifndef INCLUDED_KinectSensor_H
+#define INCLUDED_KinectSensor_H
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+#include "libfreenect.h"
+#include "DepthSensor.h"
+
+/*
+ * every KinectSensor has its own freenect context and event thread, so any
+ * number of sensors can be captured independently from one process.
+ */
+class KinectSensor : public DepthSensor {
+public:
+	/*
+	 * format is FREENECT_DEPTH_11BIT, FREENECT_DEPTH_11BIT_PACKED or
+	 * FREENECT_DEPTH_MM. raw disparities are converted to millimeters while
+	 * fetching the frame unless convertMillimeters is false.
+	 */
+	KinectSensor(freenect_depth_format format = FREENECT_DEPTH_11BIT, bool convertMillimeters = true);
+	~KinectSensor();
+
+	// opens the sensor with the given camera serial (NULL: first sensor) and starts capturing
+	int open(const char* serial);
+	void close();
+
+	int waitFrame(KinnectFrameInfo& info, int timeoutMs);
+
+	uint16_t* getDepthMap();
+	const uint64_t* getValidMask() { return ingestMask ? &validMask[0] : NULL; }
+	void setIngestArea(const ActiveArea* area);
+
+	bool rawDisparities() const { return format != FREENECT_DEPTH_MM && !convertMillimeters; }
+	uint16_t invalidDepth() const { return rawDisparities() ? FREENECT_DEPTH_RAW_NO_VALUE : 0; }
+
+	const std::string& getSerial() const { return serial; }
+
+	// green led while idle, red while touches are detected
+	void setIdle(bool idle) { this->idle = idle; }
+
+	// camera serials of all connected sensors
+	static int listSerials(std::vector<std::string>& serials);
+
+private:
+	freenect_depth_format format;
+	bool convertMillimeters;
+	std::string serial;
+
+	int die;
+	volatile bool idle;		// led state wanted by setIdle, set by the event thread
+	pthread_t thread;
+	freenect_context *ctx;
+	freenect_device *dev;
+
+	// triple buffer: libfreenect writes into back, mid holds the newest
+	// complete frame and front is owned by the consumer. frames are handed
+	// over by swapping pointers, the pixels are never copied.
+	// with FREENECT_DEPTH_11BIT_PACKED the buffers hold packed frames, which
+	// are unpacked once into ingest when the consumer fetches them. raw
+	// disparities are converted to millimeters with toMillimeters in that same
+	// pass (FREENECT_DEPTH_MM frames are already in millimeters and stay zero copy).
+	uint16_t *buffers;
+	uint16_t *back, *mid, *front;
+	uint16_t *ingest;
+	std::vector<uint64_t> validMask;	// of ingest, built row by row while the row is in L1
+	bool ingestMask;					// the last frame went through ingest
+	const ActiveArea* ingestArea;		// rows are only converted inside it (NULL: all)
+	uint16_t toMillimeters[2048];
+	int gotDepth;
+	unsigned int midSequence, midTimestamp;	// frame in mid
+	unsigned int frontSequence;				// frame in front
+	pthread_mutex_t mutex;
+	pthread_cond_t frameCond;
+
+	static void depthCallback(freenect_device *dev, void *v_depth, uint32_t timestamp);
+	static void *threadFunc(void *arg);
+	void run();
+};
+
+#endif
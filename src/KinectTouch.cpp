@@ -15,7 +15,13 @@
 
 #include <iostream>
 #include <vector>
+#include <string>
 #include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
 using namespace std;
 
 // openCV
@@ -23,23 +29,15 @@ using namespace std;
 #include <opencv/cv.h>
 using namespace cv;
 
-#define FREENECT
-
-#ifdef FREENECT
-#include "libfreenect.h"
-#include <pthread.h>
-#else
-// openNI
-#include <XnOpenNI.h>
-#include <XnCppWrapper.h>
-using namespace xn;
-#define CHECK_RC(rc, what)											\
-	if (rc != XN_STATUS_OK)											\
-	{																\
-		printf("%s failed: %s\n", what, xnGetStatusString(rc));		\
-		return rc;													\
-	}
+#include "DepthSensor.h"
+#include "KinectSensor.h"
+#include "FileDepthSensor.h"
+#include "SyntheticDepthSensor.h"
+#ifdef HAVE_OPENNI
+#include "OpenNISensor.h"
 #endif
+#include "TouchSensor.h"
+#include "Benchmark.h"
 
 // TUIO
 #include "TuioServer.h"
@@ -51,222 +49,301 @@ using namespace TUIO;
 // Globals
 //---------------------------------------------------------------------------
 
-#ifdef FREENECT
-int die = 0;
-pthread_t freenect_thread;
-freenect_context *f_ctx;
-freenect_device *f_dev;
-ushort depth_mid[640*480], depth_front[640*480];
-int got_depth = 0;
-pthread_mutex_t gl_backbuf_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t gl_frame_cond = PTHREAD_COND_INITIALIZER;
+bool mousePressed = false;
 
-#else
-// openNI
-xn::Context xnContext;
-xn::DepthGenerator xnDepthGenerator;
-xn::ImageGenerator xnImgeGenertor;
-#endif
+// set by SIGUSR1 (or the 'b' key): retrain the background of all sensors while running
+volatile sig_atomic_t retrainRequested = 0;
 
-bool mousePressed = false;
+// depth source selected with --source
+enum SourceType {
+	SOURCE_FREENECT,
+	SOURCE_OPENNI,
+	SOURCE_FILE,
+	SOURCE_SYNTHETIC
+};
 
 //---------------------------------------------------------------------------
 // Functions
 //---------------------------------------------------------------------------
 
-#ifdef FREENECT
-void depth_cb(freenect_device *dev, void *v_depth, uint32_t timestamp)
-{
-	int i;
-	pthread_mutex_lock(&gl_backbuf_mutex);
-	pthread_cond_init(&gl_frame_cond, NULL);
-	ushort *depth = (ushort*)v_depth;
-
-	for (i = 0; i < 640*480; i++) {
-		depth_mid[i] = depth[i];
-	}
-	got_depth++;
-
-	pthread_cond_signal(&gl_frame_cond);
-	pthread_mutex_unlock(&gl_backbuf_mutex);
-	pthread_cond_init(&gl_frame_cond, NULL);
+void onRetrainSignal(int) {
+	retrainRequested = 1;
 }
 
-void *freenect_threadfunc(void *arg)
-{
-
-	freenect_set_led(f_dev, LED_RED);
-	freenect_set_depth_callback(f_dev, depth_cb);
-	freenect_set_depth_mode(f_dev, freenect_find_depth_mode(FREENECT_RESOLUTION_MEDIUM, FREENECT_DEPTH_11BIT));
-//typedef enum {
-//	FREENECT_RESOLUTION_LOW    = 0, /**< QVGA - 320x240 */
-//	FREENECT_RESOLUTION_MEDIUM = 1, /**< VGA  - 640x480 */
-//	FREENECT_RESOLUTION_HIGH   = 2, /**< SXGA - 1280x1024 */
-//	FREENECT_RESOLUTION_DUMMY  = 2147483647, /**< Dummy value to force enum to be 32 bits wide */
-//} freenect_resolution;
-//typedef enum {
-//	FREENECT_DEPTH_11BIT        = 0, /**< 11 bit depth information in one uint16_t/pixel */
-//	FREENECT_DEPTH_10BIT        = 1, /**< 10 bit depth information in one uint16_t/pixel */
-//	FREENECT_DEPTH_11BIT_PACKED = 2, /**< 11 bit packed depth information */
-//	FREENECT_DEPTH_10BIT_PACKED = 3, /**< 10 bit packed depth information */
-//	FREENECT_DEPTH_REGISTERED   = 4, /**< processed depth data in mm, aligned to 640x480 RGB */
-//	FREENECT_DEPTH_MM           = 5, /**< depth to each pixel in mm, but left unaligned to RGB image */
-//	FREENECT_DEPTH_DUMMY        = 2147483647, /**< Dummy value to force enum to be 32 bits wide */
-//} freenect_depth_format;
-
-	freenect_start_depth(f_dev);
-
-	printf("\nstarting freenect_threadfunc\n");
-
-	while (die == 0 && freenect_process_events(f_ctx) >= 0) {
-		;;
-	}
-
-	printf("\nshutting down streams...\n");
-
-	freenect_stop_depth(f_dev);
-
-	freenect_close_device(f_dev);
-	freenect_shutdown(f_ctx);
-
-	printf("-- done!\n");
-	return NULL;
-}
-
-int initKinnect() {
-
-	pthread_mutex_init(&gl_backbuf_mutex, NULL);
-	pthread_cond_init(&gl_frame_cond, NULL);
-
-	// setup
-	if (freenect_init(&f_ctx, NULL) < 0) {
-	  printf("freenect_init() failed\n");
-	  return 1;
-	}
-
-	freenect_set_log_level(f_ctx, FREENECT_LOG_DEBUG);
-	freenect_select_subdevices(f_ctx, (freenect_device_flags)(FREENECT_DEVICE_CAMERA));
-
-	int nr_devices = freenect_num_devices(f_ctx);
-	printf ("Number of devices found: %d\n", nr_devices);
-
-	if (nr_devices <= 0) {
-	  printf("devices not found\n");
-		freenect_shutdown(f_ctx);
-		return -1;
-	}
-
-	if (freenect_open_device(f_ctx, &f_dev, 0) < 0) {
-	  printf("Could not open device\n");
-		freenect_shutdown(f_ctx);
-		return -1;
-	}
-
-	// depth読み取り用のスレッド起動
-	int res = pthread_create(&freenect_thread, NULL, freenect_threadfunc, NULL);
-	if (res) {
-		printf("pthread_create failed\n");
-		freenect_close_device(f_dev);
-		freenect_shutdown(f_ctx);
-		return -1;
-	}
-
-	return 0;
-}
-void updateKinnect() {
-	//while (!got_depth) {
-	//		pthread_cond_wait(&gl_frame_cond, &gl_backbuf_mutex);
-	//}
-}
-uchar* getKinnectDepthMap() {
-	int i;
-	pthread_mutex_lock(&gl_backbuf_mutex);
-	for (i = 0; i < 640*480; i++) {
-		depth_front[i] = depth_mid[i];
-	}
-	got_depth = 0;
-	pthread_mutex_unlock(&gl_backbuf_mutex);
-
-	return (uchar *)depth_front;
-}
-#else
-int initKinnect() {
-	const XnChar* fname = "niConfig.xml";
-	XnStatus nRetVal = XN_STATUS_OK;
-
-	// initialize context
-	nRetVal = xnContext.InitFromXmlFile(fname);
-	CHECK_RC(nRetVal, "InitFromXmlFile");
-
-	// initialize depth generator
-	nRetVal = xnContext.FindExistingNode(XN_NODE_TYPE_DEPTH, xnDepthGenerator);
-	CHECK_RC(nRetVal, "FindExistingNode(XN_NODE_TYPE_DEPTH)");
-
-	// initialize image generator
-	nRetVal = xnContext.FindExistingNode(XN_NODE_TYPE_IMAGE, xnImgeGenertor);
-	CHECK_RC(nRetVal, "FindExistingNode(XN_NODE_TYPE_IMAGE)");
-
-	return 0;
-}
-void updateKinnect() {
-	xnContext.WaitAndUpdateAll();
-}
-ushort* getKinnectDepthMap() {
-	return (uchar*) xnDepthGenerator.GetDepthMap();
-}
-#endif
-
-void average(vector<Mat1s>& frames, Mat1s& mean) {
-	Mat1d acc(mean.size());
-	Mat1d frame(mean.size());
-
-	for (unsigned int i=0; i<frames.size(); i++) {
-		frames[i].convertTo(frame, CV_64FC1);
-		acc = acc + frame;
+// merges the touches of all sensors. touches of different sensors closer than
+// mergeDistance (surface coordinates) are the same finger seen in an overlapping
+// region and are averaged into one touch. the sensors are merged one after the
+// other, so a touch already has a point of sensor s if s is the last sensor
+// that contributed to it (any number of sensors).
+void mergeTouches(const vector< vector<Point2f> >& sensorTouches, float mergeDistance, vector<Point2f>& touches) {
+	vector<unsigned int> lastSensor;	// last sensor that contributed to touches[j]
+	vector<int> count;
+
+	touches.clear();
+	for (unsigned int s = 0; s < sensorTouches.size(); s++) {
+		for (unsigned int i = 0; i < sensorTouches[s].size(); i++) {
+			const Point2f& p = sensorTouches[s][i];
+			int closest = -1;
+			float closestDistance = mergeDistance * mergeDistance;
+			for (unsigned int j = 0; j < touches.size(); j++) {
+				float dx = touches[j].x - p.x, dy = touches[j].y - p.y;
+				if (lastSensor[j] != s && dx * dx + dy * dy < closestDistance) {
+					closest = j;
+					closestDistance = dx * dx + dy * dy;
+				}
+			}
+			if (closest < 0) {
+				touches.push_back(p);
+				lastSensor.push_back(s);
+				count.push_back(1);
+			} else {
+				Point2f& t = touches[closest];
+				t.x = (t.x * count[closest] + p.x) / (count[closest] + 1);
+				t.y = (t.y * count[closest] + p.y) / (count[closest] + 1);
+				lastSensor[closest] = s;
+				count[closest]++;
+			}
+		}
 	}
-
-	acc = acc / frames.size();
-
-	acc.convertTo(mean, CV_16SC1);
 }
 
-int main() {
+int main(int argc, char** argv) {
 
 	const unsigned int nBackgroundTrain = 30;	// サンプリング回数
-	int touchDepthMin = 10;	// タッチ判定の最小値(defautl:10)
-	int touchDepthMax = 20;	// タッチ判定の最大値(default:20)
-	int touchMinArea = 50;		// このエリアよりも輪郭が大きいなら、タッチ箇所とみなす
+	const float mergeDistance = 0.02;			// touches of different sensors closer than this are merged (surface coordinates)
 
 	const bool localClientMode = false; 		// connect to a local client
 
-	const double debugFrameMaxDepth = 4000;		// maximal distance (in millimeters) for 8 bit debug depth frame quantization. 4000mm === 4m
 	const char* windowName = "TouchReader";			// ウィンドウ名
-	const Scalar debugColor0(0, 0, 128);		// タッチ近似領域の色：Scalr(Blue, Green, Red) === (0x800000) === red
-	const Scalar debugColor1(255, 0, 0);		// ROIを囲む枠線の色
-	const Scalar debugColor2(255, 255, 255);	// タッチの色
 
 	const int xMin = 0;
 	const int xMax = 640;
 	const int yMin = 00;
 	const int yMax = 480;
 
-	Mat1s depth(480, 640);		// 16 bit depth (in millimeters) <Mat1s === short>
-	Mat1b depth8(480, 640);		// 8 bit depth <Mat1b === uchar>
-	//Mat3b rgb(480, 640);		// 8 bit depth <Mat3b === Vec3b<r,g,b>>
+	bool pyramid = false;
+	bool headless = false;
+	SourceType source = SOURCE_FREENECT;
+	vector<string> serials;		// sensors to open (all connected sensors if empty)
+	vector<Rect_<float> > areas;	// part of the surface each sensor covers (width 0: automatic)
+	vector<string> activeAreas;		// polygon of the sensor image covering the surface (empty: roi)
+	string defaultActiveArea;
+	freenect_depth_format depthFormat = FREENECT_DEPTH_11BIT;
+	bool convertMillimeters = true;
+	bool realtime = true;
+	int loops = 1;
+	const char* recordFile = NULL;
+	RecordingEncoding recordEncoding = RECORDING_ENCODING_RAW;
+	int adaptInterval = 4;
+	const char* snapshotFile = NULL;
+	int holeFill = 0;
+	bool robustTraining = false;
+	int benchmarkFrames = 0;
+	int threads = 1;
+	bool openMask = false, closeMask = false;
+	bool skipUnchanged = false;
+	float idleSeconds = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--pyramid") == 0) {
+			pyramid = true;								// coarse to fine segmentation
+		} else if (strcmp(argv[i], "--headless") == 0) {
+			headless = true;							// no debug windows
+		} else if (strcmp(argv[i], "--source") == 0 && i + 1 < argc) {
+			// --source freenect|openni|file|synthetic
+			i++;
+			if (strcmp(argv[i], "openni") == 0) {
+#ifdef HAVE_OPENNI
+				source = SOURCE_OPENNI;
+#else
+				printf("source openni is not available, built without OpenNI\n");
+				return -1;
+#endif
+			} else if (strcmp(argv[i], "file") == 0) {
+				source = SOURCE_FILE;
+			} else if (strcmp(argv[i], "synthetic") == 0) {
+				source = SOURCE_SYNTHETIC;
+			} else if (strcmp(argv[i], "freenect") == 0) {
+				source = SOURCE_FREENECT;
+			} else {
+				printf("unknown source %s (freenect, openni, file or synthetic)\n", argv[i]);
+				return -1;
+			}
+		} else if (strcmp(argv[i], "--fast") == 0) {
+			realtime = false;							// replay files (or render synthetic scenes) as fast as possible
+		} else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			recordFile = argv[++i];						// record the depth stream (FILE.SERIAL with several sensors)
+		} else if (strcmp(argv[i], "--compress") == 0) {
+			recordEncoding = RECORDING_ENCODING_RICE;	// lossless compressed recording
+		} else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+			snapshotFile = argv[++i];					// load/save the background (FILE.SERIAL with several sensors)
+		} else if (strcmp(argv[i], "--fill-holes") == 0 && i + 1 < argc) {
+			holeFill = atoi(argv[++i]);					// fill background holes up to n pixels wide
+		} else if (strcmp(argv[i], "--robust-training") == 0) {
+			robustTraining = true;						// median based training, hands may be on the table
+		} else if (strcmp(argv[i], "--adapt") == 0 && i + 1 < argc) {
+			adaptInterval = atoi(argv[++i]);			// adapt the background every n frames (0: never)
+		} else if (strcmp(argv[i], "--loops") == 0 && i + 1 < argc) {
+			loops = atoi(argv[++i]);					// replay files n times (0: forever)
+		} else if (strcmp(argv[i], "--sensor") == 0 && i + 1 < argc) {
+			// --sensor SERIAL[@x0,y0,x1,y1] (file name for --source file, scene for --source synthetic)
+			char serial[64] = "";
+			float x0, y0, x1, y1;
+			if (sscanf(argv[++i], "%63[^@]@%f,%f,%f,%f", serial, &x0, &y0, &x1, &y1) == 5) {
+				areas.push_back(Rect_<float>(x0, y0, x1 - x0, y1 - y0));
+			} else {
+				areas.push_back(Rect_<float>());
+			}
+			serials.push_back(serial);
+			activeAreas.push_back(defaultActiveArea);
+		} else if (strcmp(argv[i], "--area") == 0 && i + 1 < argc) {
+			// --area x,y;x,y;... active area of the last --sensor (of all sensors before the first one)
+			if (serials.empty()) {
+				defaultActiveArea = argv[++i];
+			} else {
+				activeAreas.back() = argv[++i];
+			}
+		} else if (strcmp(argv[i], "--packed") == 0) {
+			depthFormat = FREENECT_DEPTH_11BIT_PACKED;	// unpack 11 bit depth ourselves
+		} else if (strcmp(argv[i], "--depth-mm") == 0) {
+			depthFormat = FREENECT_DEPTH_MM;			// let libfreenect convert to millimeters
+		} else if (strcmp(argv[i], "--raw") == 0) {
+			convertMillimeters = false;					// keep raw disparities (thresholds in disparity units)
+		} else if (strcmp(argv[i], "--open") == 0) {
+			openMask = true;							// remove specks from the touch mask
+		} else if (strcmp(argv[i], "--close") == 0) {
+			closeMask = true;							// fill pinholes of the touch mask
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			threads = atoi(argv[++i]);					// segmentation threads per sensor (0: one per core)
+			if (threads <= 0) {
+				threads = sysconf(_SC_NPROCESSORS_ONLN);
+			}
+		} else if (strcmp(argv[i], "--benchmark") == 0) {
+			benchmarkFrames = 100;						// time the segmentation on synthetic frames and exit
+			if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+				benchmarkFrames = atoi(argv[++i]);
+			}
+		} else if (strcmp(argv[i], "--idle") == 0 && i + 1 < argc) {
+			idleSeconds = atof(argv[++i]);				// lower the frame rate after this many seconds without hands
+		} else if (strcmp(argv[i], "--skip-unchanged") == 0) {
+			skipUnchanged = true;						// no labelling while the touch mask of an empty table stays the same
+		}
+	}
 
-	Mat3b debug(480, 640);		// debug visualization
+	if (benchmarkFrames > 0) {
+		return runBenchmark(benchmarkFrames);
+	}
 
-	Mat1s foreground(640, 480);
-	Mat1b foreground8(640, 480);
+	if (serials.empty()) {
+		if (source == SOURCE_FREENECT) {
+			KinectSensor::listSerials(serials);
+#ifdef HAVE_OPENNI
+		} else if (source == SOURCE_OPENNI) {
+			OpenNISensor::listSerials(serials);
+#endif
+		} else if (source == SOURCE_SYNTHETIC) {
+			serials.push_back("fingers=10");	// see SyntheticDepthSensor.h
+		}
+		areas.resize(serials.size());
+		activeAreas.resize(serials.size(), defaultActiveArea);
+	}
+	printf ("Number of devices found: %d\n", (int)serials.size());
+	if (serials.empty()) {
+		printf("devices not found\n");
+		return -1;
+	}
 
-	Mat1b touch(640, 480); // touch mask
+	// one capture and segmentation thread per sensor. sensors without an
+	// explicit area are placed side by side.
+	vector<TouchSensor*> sensors;
+	vector<string> windowNames;
+	for (unsigned int i = 0; i < serials.size(); i++) {
+		DepthSensor* sensor;
+		if (source == SOURCE_FILE) {
+			sensor = new FileDepthSensor(realtime, loops);
+		} else if (source == SOURCE_SYNTHETIC) {
+			sensor = new SyntheticDepthSensor(realtime);
+#ifdef HAVE_OPENNI
+		} else if (source == SOURCE_OPENNI) {
+			sensor = new OpenNISensor();
+#endif
+		} else {
+			sensor = new KinectSensor(depthFormat, convertMillimeters);
+		}
+		if (sensor->open(serials[i].c_str()) != 0) {
+			printf("initKinnect Error\n");
+			delete sensor;
+			return -1;
+		}
 
-	Mat1s background(480, 640);
-	vector<Mat1s> buffer(nBackgroundTrain);
+		// a recording replays with the calibration it was taken with, unless
+		// the command line sets the active area or surface of this sensor
+		const RecordingHeader* recording = NULL;
+		if (source == SOURCE_FILE) {
+			recording = &((FileDepthSensor*)sensor)->getHeader();
+		}
 
-	if (initKinnect() != 0) {
-		printf("initKinnect Error\n");
-		return -1;
+		TouchSensor* touchSensor = new TouchSensor(sensor, nBackgroundTrain);
+		touchSensor->debugEnabled = !headless;
+		touchSensor->detector.roi = Rect(xMin, yMin, xMax - xMin, yMax - yMin);
+		if (recording && recording->roi[2] > 0 && recording->roi[3] > 0) {
+			touchSensor->detector.roi = Rect(recording->roi[0], recording->roi[1], recording->roi[2], recording->roi[3]);
+		}
+		if (!activeAreas[i].empty()) {
+			vector<AreaPoint> polygon;
+			if (!ActiveArea::parsePolygon(activeAreas[i].c_str(), polygon)) {
+				printf("invalid active area %s\n", activeAreas[i].c_str());
+				return -1;
+			}
+			touchSensor->activeArea.setPolygon(polygon);
+			int x0, y0, x1, y1;
+			touchSensor->activeArea.getBounds(x0, y0, x1, y1);
+			touchSensor->detector.roi = Rect(x0, y0, x1 - x0, y1 - y0);
+		} else {
+			const Rect& roi = touchSensor->detector.roi;
+			touchSensor->activeArea.setRect(roi.x, roi.y, roi.width, roi.height);
+		}
+		printf("sensor %s: active area %d pixels (%.0f%%)\n", serials[i].c_str(), touchSensor->activeArea.getPixels(), touchSensor->activeArea.getPixels() * 100.0 / (640 * 480));
+		touchSensor->detector.pyramid = pyramid;
+		touchSensor->detector.setThreads(threads);
+		touchSensor->detector.openMask = openMask;
+		touchSensor->detector.closeMask = closeMask;
+		touchSensor->detector.skipUnchanged = skipUnchanged;
+		touchSensor->idleSeconds = idleSeconds;
+		touchSensor->adaptInterval = adaptInterval;
+		touchSensor->holeFill = holeFill;
+		touchSensor->robustTraining = robustTraining;
+		if (snapshotFile) {
+			touchSensor->snapshotFile = serials.size() == 1 ? string(snapshotFile) : string(snapshotFile) + "." + serials[i];
+		}
+		if (areas[i].width > 0) {
+			touchSensor->surfaceX0 = areas[i].x;
+			touchSensor->surfaceY0 = areas[i].y;
+			touchSensor->surfaceX1 = areas[i].x + areas[i].width;
+			touchSensor->surfaceY1 = areas[i].y + areas[i].height;
+		} else if (recording && recording->surface[2] > recording->surface[0] && recording->surface[3] > recording->surface[1]) {
+			touchSensor->surfaceX0 = recording->surface[0];
+			touchSensor->surfaceY0 = recording->surface[1];
+			touchSensor->surfaceX1 = recording->surface[2];
+			touchSensor->surfaceY1 = recording->surface[3];
+		} else {
+			touchSensor->surfaceX0 = (float)i / serials.size();
+			touchSensor->surfaceX1 = (float)(i + 1) / serials.size();
+		}
+		if (recordFile) {
+			DepthRecorder* recorder = new DepthRecorder(recordEncoding);
+			string name = serials.size() == 1 ? string(recordFile) : string(recordFile) + "." + serials[i];
+			const Rect& roi = touchSensor->detector.roi;
+			int recordRoi[4] = { roi.x, roi.y, roi.width, roi.height };
+			float recordSurface[4] = { touchSensor->surfaceX0, touchSensor->surfaceY0, touchSensor->surfaceX1, touchSensor->surfaceY1 };
+			RecordingDepthFormat recordFormat = sensor->rawDisparities() ? RECORDING_DEPTH_RAW11 : RECORDING_DEPTH_MM;
+			if (recorder->open(name.c_str(), recordFormat, recordRoi, recordSurface) == 0) {
+				touchSensor->recorder = recorder;
+			} else {
+				delete recorder;
+			}
+		}
+		sensors.push_back(touchSensor);
+		windowNames.push_back(serials.size() == 1 ? string(windowName) : string(windowName) + " " + serials[i]);
 	}
 
 	// TUIO server object
@@ -282,116 +359,115 @@ int main() {
 	TuioTime time;
 
 	// create some sliders
-	namedWindow(windowName);
+	for (unsigned int i = 0; i < sensors.size() && !headless; i++) {
+		const char* name = windowNames[i].c_str();
+		namedWindow(name);
 /*
-	createTrackbar("xMin", windowName, &xMin, 640);
-	createTrackbar("xMax", windowName, &xMax, 640);
-	createTrackbar("yMin", windowName, &yMin, 480);
-	createTrackbar("yMax", windowName, &yMax, 480);
+		createTrackbar("xMin", name, &xMin, 640);
+		createTrackbar("xMax", name, &xMax, 640);
+		createTrackbar("yMin", name, &yMin, 480);
+		createTrackbar("yMax", name, &yMax, 480);
 //*/
-	createTrackbar("touchDepthMin", windowName, &touchDepthMin, 100);
-	createTrackbar("touchDepthMax", windowName, &touchDepthMax, 100);
-	createTrackbar("touchMinArea", windowName, &touchMinArea, 100);
-
-	// create background model (average depth)
-	for (unsigned int i=0; i<nBackgroundTrain; i++) {
-		updateKinnect();
-		depth.data = getKinnectDepthMap();
-		buffer[i] = depth;
+		createTrackbar("touchDepthMin", name, &sensors[i]->detector.touchDepthMin, 100);
+		createTrackbar("touchDepthMax", name, &sensors[i]->detector.touchDepthMax, 100);
+		createTrackbar("touchMinArea", name, &sensors[i]->detector.touchMinArea, 100);
 	}
-	average(buffer, background);
-
-	while ( waitKey(1) != 27 ) {
-		// データ読み取り
-		updateKinnect();
-
-		// update 16 bit depth matrix
-		depth.data = getKinnectDepthMap();
-		//xnImgeGenertor.GetGrayscale8ImageMap()
-
-		// update rgb image
-		//rgb.data = (uchar*) xnImgeGenertor.GetRGB24ImageMap(); // segmentation fault here
-		//cvtColor(rgb, rgb, CV_RGB2BGR);
-
-		// extract foreground by simple subtraction of very basic background model
-		foreground = background - depth;
-
-		// タッチマスク
-		// find touch mask by thresholding (points that are close to background = touch points)
-		touch = (foreground > touchDepthMin) & (foreground < touchDepthMax);
-
-		// extract ROI
-		Rect roi(xMin, yMin, xMax - xMin, yMax - yMin);
-		Mat touchRoi = touch(roi);
-
-		// タッチ位置を探す
-		vector< vector<Point2i> > contours;
-		vector<Point2f> touchPoints;//タッチ位置
-		findContours(touchRoi, contours, CV_RETR_LIST, CV_CHAIN_APPROX_SIMPLE, Point2i(xMin, yMin));//輪郭を探しだす by OpenCV
-		for (unsigned int i=0; i<contours.size(); i++) {
-			Mat contourMat(contours[i]);
-			// find touch points by area thresholding
-			if ( contourArea(contourMat) > touchMinArea ) {	// 小さすぎる点はタッチと見なさない
-				Scalar center = mean(contourMat);
-				Point2i touchPoint(center[0], center[1]);
-				touchPoints.push_back(touchPoint);
+
+	for (unsigned int i = 0; i < sensors.size(); i++) {
+		sensors[i]->start();
+	}
+
+	vector< vector<Point2f> > sensorTouches(sensors.size());
+	vector<unsigned int> sensorSequences(sensors.size(), 0);
+	vector<Point2f> touchPoints;//タッチ位置
+
+	signal(SIGUSR1, onRetrainSignal);
+
+	for (;;) {
+		if (headless) {
+			usleep(1000);
+		} else {
+			int key = waitKey(1);
+			if (key == 27) {
+				break;
+			}
+			if (key == 'b') {
+				retrainRequested = 1;
+			}
+		}
+		if (retrainRequested) {
+			retrainRequested = 0;
+			for (unsigned int i = 0; i < sensors.size(); i++) {
+				sensors[i]->retrain();
+			}
+		}
+
+		// replayed files end at some point
+		bool running = false;
+		for (unsigned int i = 0; i < sensors.size(); i++) {
+			running = running || sensors[i]->isRunning();
+		}
+
+		// collect the touches of every sensor that processed a new frame
+		bool updated = false;
+		for (unsigned int i = 0; i < sensors.size(); i++) {
+			if (sensors[i]->getTouches(sensorTouches[i], sensorSequences[i])) {
+				// render debug frame (with sliders)
+				if (!headless) {
+					sensors[i]->showDebugFrame(windowNames[i].c_str());
+				}
+				updated = true;
 			}
 		}
+		if (!updated) {
+			if (!running) {
+				break;
+			}
+			continue;
+		}
+
+		mergeTouches(sensorTouches, mergeDistance, touchPoints);
 
 		// send TUIO cursors
 		time = TuioTime::getSessionTime();
 		tuio->initFrame(time);
 
 		for (unsigned int i = 0; i < touchPoints.size(); i++) { // touch points
-				//float cursorX2 = (touchPoints[i].x - xMin) / (xMax - xMin);
-				float cursorX = 1- (touchPoints[i].x - xMin) / (xMax - xMin);
-				//float cursorY2 = 1 - (touchPoints[i].y - yMin)/(yMax - yMin);
-				float cursorY = (touchPoints[i].y - yMin)/(yMax - yMin);
-				cursorY = 1 - (touchPoints[i].y - yMin)/(yMax - yMin);//安東さん用
+				// already mirrored and in surface coordinates (see TouchSensor)
+				float cursorX = touchPoints[i].x;
+				float cursorY = touchPoints[i].y;
 				TuioCursor* cursor = tuio->getClosestTuioCursor(cursorX,cursorY);
 				// TODO improve tracking (don't move cursors away, that might be closer to another touch point)
 				if (cursor == NULL || cursor->getTuioTime() == time) {
 					tuio->addTuioCursor(cursorX, cursorY);
 					//printf("addTuioCursor TuioServer(%f, %f)\n", cursorX, cursorY);
-					//printf("addTuioCursor TuioServer(%f, %f)2\n", cursorX, cursorY2);
 				} else {
 					tuio->updateTuioCursor(cursor, cursorX, cursorY);
 					//printf("updateTuioCursor TuioServer(%f, %f)\n", cursorX, cursorY);
-					//printf("updateTuioCursor TuioServer(%f, %f)2\n", cursorX, cursorY2);
 				}
 		}
 
 		tuio->stopUntouchedMovingCursors();
 		tuio->removeUntouchedStoppedCursors();
 		tuio->commitFrame();
+	}
 
-		//--------------------
-		// draw debug frame
-		//--------------------
-		// render depth to debug frame
-		depth.convertTo(depth8, CV_8U, 255 / debugFrameMaxDepth);
-		cvtColor(/* in */depth8, /* out*/debug, /* 変換方法 */CV_GRAY2BGR);
-
-		// ヒートマップの描画
-		debug.setTo(debugColor0, touch);  // touch mask
-		//rectangle(debug, roi, debugColor1, 2); // surface boundaries
-
-		// タッチ位置の描画
-		for (unsigned int i = 0; i < touchPoints.size(); i++) { // touch points
-			circle(debug, touchPoints[i], 5, debugColor2, CV_FILLED);
+	for (unsigned int i = 0; i < sensors.size(); i++) {
+		sensors[i]->stop();
+		if (sensors[i]->recorder) {
+			sensors[i]->recorder->close();
+			delete sensors[i]->recorder;
 		}
-
-		// render debug frame (with sliders)
-		imshow(windowName, debug);
-		//imshow("image", rgb);
 	}
-	die++;
-	sleep(1);
 
 	printf("main thread finished.\n");
-	printf("\ttouchDepthMin = %d\n", touchDepthMin);
-	printf("\ttouchDepthMax = %d\n", touchDepthMax);
-	printf("\ttouchMinArea = %d\n", touchMinArea);
+	for (unsigned int i = 0; i < sensors.size(); i++) {
+		printf("sensor %s\n", sensors[i]->getSerial().c_str());
+		printf("\ttouchDepthMin = %d\n", sensors[i]->detector.touchDepthMin);
+		printf("\ttouchDepthMax = %d\n", sensors[i]->detector.touchDepthMax);
+		printf("\ttouchMinArea = %d\n", sensors[i]->detector.touchMinArea);
+		delete sensors[i];
+	}
 
 	return 0;
 }
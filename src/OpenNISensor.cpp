@@ -0,0 +1,75 @@
+//============================================================================
+// Name        : OpenNISensor.cpp
+// Description : depth capture through openNI (configured by niConfig.xml)
+//============================================================================
+
+#ifdef HAVE_OPENNI
+
+#include "OpenNISensor.h"
+
+#include <stdio.h>
+
+using namespace std;
+using namespace xn;
+
+#define CHECK_RC(rc, what)											\
+	if (rc != XN_STATUS_OK)											\
+	{																\
+		printf("%s failed: %s\n", what, xnGetStatusString(rc));		\
+		return rc;													\
+	}
+
+OpenNISensor::OpenNISensor()
+	: serial("openni")
+	, lastFrameId(0)
+{
+}
+
+int OpenNISensor::listSerials(vector<string>& serials) {
+	serials.push_back("openni");
+	return 1;
+}
+
+int OpenNISensor::open(const char* cameraSerial) {
+	const XnChar* fname = "niConfig.xml";
+	XnStatus nRetVal = XN_STATUS_OK;
+
+	if (cameraSerial && serial != cameraSerial) {
+		printf("openNI can not open sensors by serial, using niConfig.xml\n");
+	}
+
+	// initialize context
+	nRetVal = xnContext.InitFromXmlFile(fname);
+	CHECK_RC(nRetVal, "InitFromXmlFile");
+
+	// initialize depth generator
+	nRetVal = xnContext.FindExistingNode(XN_NODE_TYPE_DEPTH, xnDepthGenerator);
+	CHECK_RC(nRetVal, "FindExistingNode(XN_NODE_TYPE_DEPTH)");
+
+	// initialize image generator
+	nRetVal = xnContext.FindExistingNode(XN_NODE_TYPE_IMAGE, xnImgeGenertor);
+	CHECK_RC(nRetVal, "FindExistingNode(XN_NODE_TYPE_IMAGE)");
+
+	return 0;
+}
+
+void OpenNISensor::close() {
+	xnContext.Shutdown();
+}
+
+int OpenNISensor::waitFrame(KinnectFrameInfo& info, int timeoutMs) {
+	if (xnContext.WaitOneUpdateAll(xnDepthGenerator) != XN_STATUS_OK) {
+		return 0;
+	}
+	XnUInt32 frameId = xnDepthGenerator.GetFrameID();
+	info.skipped = lastFrameId ? frameId - lastFrameId - 1 : 0;
+	info.sequence = lastFrameId = frameId;
+	info.timestamp = (unsigned int) xnDepthGenerator.GetTimestamp();
+	return 1;
+}
+
+uint16_t* OpenNISensor::getDepthMap() {
+	return (uint16_t*) xnDepthGenerator.GetDepthMap();
+}
+
+#endif
@@ -0,0 +1,50 @@
+//============================================================================
+// Name        : OpenNISensor.h
+// Description : depth capture through openNI (configured by niConfig.xml)
+//============================================================================
+
+#ifndef INCLUDED_OpenNISensor_H
+#define INCLUDED_OpenNISensor_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// openNI
+#include <XnOpenNI.h>
+#include <XnCppWrapper.h>
+
+#include "DepthSensor.h"
+
+/*
+ * openNI only exposes the first sensor of niConfig.xml, so serials are
+ * not supported and listSerials always reports a single sensor.
+ * only built with HAVE_OPENNI defined (and linked with -lOpenNI).
+ */
+class OpenNISensor : public DepthSensor {
+public:
+	OpenNISensor();
+
+	int open(const char* serial);
+	void close();
+
+	// blocks until the next frame arrived. returns 1 for a new frame, 0 on error.
+	int waitFrame(KinnectFrameInfo& info, int timeoutMs);
+
+	// the current frame, 640x480 depth in millimeters
+	uint16_t* getDepthMap();
+
+	const std::string& getSerial() const { return serial; }
+
+	static int listSerials(std::vector<std::string>& serials);
+
+private:
+	std::string serial;
+	XnUInt32 lastFrameId;
+
+	xn::Context xnContext;
+	xn::DepthGenerator xnDepthGenerator;
+	xn::ImageGenerator xnImgeGenertor;
+};
+
+#endif
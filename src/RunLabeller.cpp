@@ -0,0 +1,240 @@
+//============================================================================
+// Name        : RunLabeller.cpp
+// Description : connected components of a bit packed mask, found on runs
+//============================================================================
+
+#include "RunLabeller.h"
+
+#include <algorithm>
+
+using namespace std;
+
+static inline int lowestBit(uint64_t word) {
+	return __builtin_ctzll(word);
+}
+
+// bits [from, to) of word k
+static inline uint64_t windowBits(int k, int from, int to) {
+	int lo = from - k * 64, hi = to - k * 64;
+	uint64_t bits = ~0ull;
+	if (lo > 0) {
+		bits &= ~0ull << lo;
+	}
+	if (hi < 64) {
+		bits &= (1ull << hi) - 1;
+	}
+	return bits;
+}
+
+// sum of i * i for i in [0, n)
+static inline double sumOfSquares(double n) {
+	return (n - 1) * n * (2 * n - 1) / 6;
+}
+
+void RunLabeller::findRuns(const uint64_t* row, int y, int x0, int x1) {
+	int open = -1;		// start of a run continuing into the next word
+	for (int k = x0 / 64; k * 64 < x1; k++) {
+		uint64_t word = row[k] & windowBits(k, x0, x1);
+		int base = k * 64;
+		if (open >= 0 && !(word & 1)) {
+			addRun(y, open, base);
+			open = -1;
+		}
+		while (word) {
+			int start = lowestBit(word);
+			uint64_t clear = ~(word | ((1ull << start) - 1));	// zeros from start on
+			if (clear == 0) {
+				if (open < 0) {
+					open = base + start;	// reaches the end of the word
+				}
+				break;
+			}
+			int end = lowestBit(clear);
+			addRun(y, open >= 0 ? open : base + start, base + end);
+			open = -1;
+			word &= ~((1ull << end) - 1);
+		}
+	}
+	if (open >= 0) {
+		addRun(y, open, x1);
+	}
+}
+
+void RunLabeller::addRun(int y, int x0, int x1) {
+	MaskRun run = { y, x0, x1, 0 };
+	runs.push_back(run);
+	parent.push_back(parent.size());
+
+	double length = x1 - x0;
+	double sumX = length * (x0 + x1 - 1) * 0.5;
+	Sums s = { x1 - x0, x0, y, x1, y + 1, sumX, length * y,
+			sumOfSquares(x1) - sumOfSquares(x0), sumX * y, length * y * y, 0, 0, 0, 0, 0 };
+	sums.push_back(s);
+}
+
+int RunLabeller::find(int run) {
+	while (parent[run] != run) {
+		parent[run] = parent[parent[run]];
+		run = parent[run];
+	}
+	return run;
+}
+
+void RunLabeller::join(int a, int b) {
+	a = find(a);
+	b = find(b);
+	if (a == b) {
+		return;
+	}
+	if (b < a) {
+		std::swap(a, b);
+	}
+	parent[b] = a;
+
+	Sums& to = sums[a];
+	const Sums& from = sums[b];
+	to.area += from.area;
+	if (from.x0 < to.x0) to.x0 = from.x0;
+	if (from.y0 < to.y0) to.y0 = from.y0;
+	if (from.x1 > to.x1) to.x1 = from.x1;
+	if (from.y1 > to.y1) to.y1 = from.y1;
+	to.x += from.x;
+	to.y += from.y;
+	to.xx += from.xx;
+	to.xy += from.xy;
+	to.yy += from.yy;
+	if (from.minDepth < to.minDepth) to.minDepth = from.minDepth;
+	to.depth += from.depth;
+	to.w += from.w;
+	to.wx += from.wx;
+	to.wy += from.wy;
+}
+
+RunLabeller::RunLabeller()
+	: lastRow(-2)
+	, lastRowStart(0)
+{
+}
+
+void RunLabeller::label(const uint64_t* mask, int wordsPerRow, int x, int y, int width, int height,
+		const int16_t* depth, int depthStride, const int16_t* weightBase) {
+	reset();
+	scan(mask, wordsPerRow, x, y, width, height, depth, depthStride, weightBase);
+	finish();
+}
+
+void RunLabeller::reset() {
+	runs.clear();
+	parent.clear();
+	sums.clear();
+	blobs.clear();
+	lastRow = -2;
+	lastRowStart = 0;
+}
+
+// joins the runs [current, end) of a row with the runs [previous, current)
+// of the row above that overlap them or touch them diagonally
+void RunLabeller::joinRows(int previous, int current, int end) {
+	int p = previous;
+	for (int i = current; i < end; i++) {
+		while (p < current && runs[p].x1 < runs[i].x0) {
+			p++;
+		}
+		for (int q = p; q < current && runs[q].x0 <= runs[i].x1; q++) {
+			join(q, i);
+		}
+	}
+}
+
+void RunLabeller::scan(const uint64_t* mask, int wordsPerRow, int x, int y, int width, int height,
+		const int16_t* depth, int depthStride, const int16_t* weightBase) {
+	for (int row = y; row < y + height; row++) {
+		int current = runs.size();
+		findRuns(mask + row * wordsPerRow, row, x, x + width);
+
+		if (depth) {
+			const int16_t* d = depth + row * depthStride;
+			const int16_t* base = weightBase ? weightBase + row * depthStride : NULL;
+			for (unsigned int i = current; i < runs.size(); i++) {
+				Sums& s = sums[i];
+				int minDepth = d[runs[i].x0];
+				int sum = 0;
+				int64_t w = 0, wx = 0;
+				for (int px = runs[i].x0; px < runs[i].x1; px++) {
+					if (d[px] < minDepth) {
+						minDepth = d[px];
+					}
+					sum += d[px];
+					if (base) {
+						w += d[px] - base[px];
+						wx += (int64_t)(d[px] - base[px]) * px;
+					}
+				}
+				s.minDepth = minDepth;
+				s.depth = sum;
+				if (base) {
+					s.w = w;
+					s.wx = wx;
+					s.wy = (double)w * row;
+				}
+			}
+		}
+
+		if (lastRow == row - 1) {
+			joinRows(lastRowStart, current, runs.size());
+		}
+		lastRow = row;
+		lastRowStart = current;
+	}
+}
+
+void RunLabeller::append(const RunLabeller& stripe) {
+	if (stripe.lastRow < 0) {
+		return;		// nothing scanned
+	}
+	int offset = runs.size();
+	runs.insert(runs.end(), stripe.runs.begin(), stripe.runs.end());
+	sums.insert(sums.end(), stripe.sums.begin(), stripe.sums.end());
+	for (unsigned int i = 0; i < stripe.parent.size(); i++) {
+		parent.push_back(stripe.parent[i] + offset);
+	}
+
+	// join the first row of the stripe to the last row scanned so far
+	int end = offset;
+	while (end < (int)runs.size() && runs[end].y == lastRow + 1) {
+		end++;
+	}
+	joinRows(lastRowStart, offset, end);
+
+	lastRow = stripe.lastRow;
+	lastRowStart = offset + stripe.lastRowStart;
+}
+
+void RunLabeller::finish() {
+	// the roots hold the sums of their blobs and come before their other runs
+	for (unsigned int i = 0; i < runs.size(); i++) {
+		int root = find(i);
+		if (root != (int)i) {
+			runs[i].label = runs[root].label;
+			continue;
+		}
+		const Sums& s = sums[i];
+		MaskBlob blob;
+		blob.area = s.area;
+		blob.x0 = s.x0;
+		blob.y0 = s.y0;
+		blob.x1 = s.x1;
+		blob.y1 = s.y1;
+		blob.cx = s.x / s.area;
+		blob.cy = s.y / s.area;
+		blob.xx = s.xx / s.area - blob.cx * blob.cx;
+		blob.xy = s.xy / s.area - blob.cx * blob.cy;
+		blob.yy = s.yy / s.area - blob.cy * blob.cy;
+		blob.minDepth = s.minDepth;
+		blob.meanDepth = s.depth / s.area;
+		blob.wx = s.w > 0 ? s.wx / s.w : blob.cx;
+		blob.wy = s.w > 0 ? s.wy / s.w : blob.cy;
+		runs[i].label = blobs.size();
+		blobs.push_back(blob);
+	}
+}
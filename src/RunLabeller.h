@@ -0,0 +1,93 @@
+//============================================================================
+// Name        : RunLabeller.h
+// Description : connected components of a bit packed mask, found on runs
+//============================================================================
+
+#ifndef INCLUDED_RunLabeller_H
+#define INCLUDED_RunLabeller_H
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+// horizontal run of set pixels [x0, x1) in row y
+struct MaskRun {
+	int y;
+	int x0, x1;
+	int label;		// index of the blob after label()
+};
+
+struct MaskBlob {
+	int area;				// pixels
+	int x0, y0, x1, y1;		// bounding box, x1 and y1 exclusive
+	double cx, cy;			// center of the pixels (first moments / area)
+	double xx, xy, yy;		// central second moments / area (covariance of the pixel positions)
+	int minDepth;			// smallest depth of the pixels (0 without depth)
+	double meanDepth;
+	double wx, wy;			// center weighted by depth - weightBase (cx, cy without weights)
+};
+
+/*
+ * 8-connected components of a mask with one bit per pixel (bit x % 64 of
+ * word x / 64 of each row). the runs of a row are found with bit scans
+ * and joined to the runs of the previous row they touch by union find.
+ * the sums of every run are merged into its root as the runs are joined,
+ * so a single scan gives the statistics of all blobs. the work depends on
+ * the number of runs (and of set pixels, if depth is given), not on the
+ * size of the window.
+ */
+class RunLabeller {
+public:
+	RunLabeller();
+
+	/*
+	 * labels the pixels inside the window (x, y, width, height) only.
+	 * depth (depthStride values per row) is optional and only needed for
+	 * the depth of the blobs. with weightBase (same layout as depth), every
+	 * pixel also counts depth - weightBase times for the weighted center.
+	 */
+	void label(const uint64_t* mask, int wordsPerRow, int x, int y, int width, int height,
+			const int16_t* depth = NULL, int depthStride = 0, const int16_t* weightBase = NULL);
+
+	/*
+	 * label() in steps, for labelling horizontal stripes in parallel: every
+	 * stripe is scanned by its own labeller, the stripes are then appended
+	 * top to bottom to one labeller, which joins the runs at the borders.
+	 * the blobs are the same as with label() on the whole window, in the
+	 * same order and with the same statistics (all sums are exact).
+	 */
+	void reset();
+	void scan(const uint64_t* mask, int wordsPerRow, int x, int y, int width, int height,
+			const int16_t* depth = NULL, int depthStride = 0, const int16_t* weightBase = NULL);
+	void append(const RunLabeller& stripe);
+	void finish();
+
+	const std::vector<MaskRun>& getRuns() const { return runs; }
+	const std::vector<MaskBlob>& getBlobs() const { return blobs; }
+
+private:
+	// moments of a run, or of all runs joined to it while it is a root
+	struct Sums {
+		int area;
+		int x0, y0, x1, y1;
+		double x, y, xx, xy, yy;
+		int minDepth;
+		double depth;
+		double w, wx, wy;	// weights and weighted positions
+	};
+
+	std::vector<MaskRun> runs;
+	std::vector<int> parent;		// union find of the runs
+	std::vector<Sums> sums;
+	std::vector<MaskBlob> blobs;
+	int lastRow;			// last scanned row
+	int lastRowStart;		// its first run
+
+	void findRuns(const uint64_t* row, int y, int x0, int x1);
+	void addRun(int y, int x0, int x1);
+	int find(int run);
+	void join(int a, int b);
+	void joinRows(int previous, int current, int end);
+};
+
+#endif
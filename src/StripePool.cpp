@@ -0,0 +1,109 @@
+//============================================================================
+// Name        : StripePool.cpp
+// Description : persistent worker threads for processing a frame in stripes
+//============================================================================
+
+#include "StripePool.h"
+
+#include <stdio.h>
+
+StripePool::StripePool(int threads)
+	: task(NULL)
+	, context(NULL)
+	, stripes(0)
+	, next(0)
+	, pending(0)
+	, generation(0)
+	, die(0)
+{
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&startCond, NULL);
+	pthread_cond_init(&doneCond, NULL);
+
+	for (int i = 1; i < threads; i++) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, threadFunc, this)) {
+			printf("pthread_create failed, %d stripe threads\n", (int)workers.size() + 1);
+			break;
+		}
+		workers.push_back(thread);
+	}
+}
+
+StripePool::~StripePool() {
+	pthread_mutex_lock(&mutex);
+	die = 1;
+	pthread_cond_broadcast(&startCond);
+	pthread_mutex_unlock(&mutex);
+	for (unsigned int i = 0; i < workers.size(); i++) {
+		pthread_join(workers[i], NULL);
+	}
+
+	pthread_cond_destroy(&doneCond);
+	pthread_cond_destroy(&startCond);
+	pthread_mutex_destroy(&mutex);
+}
+
+void StripePool::run(Task task, void* context, int stripes) {
+	pthread_mutex_lock(&mutex);
+	this->task = task;
+	this->context = context;
+	this->stripes = stripes;
+	next = 0;
+	pending = stripes;
+	generation++;
+	pthread_cond_broadcast(&startCond);
+	pthread_mutex_unlock(&mutex);
+
+	work();
+
+	pthread_mutex_lock(&mutex);
+	while (pending > 0) {
+		pthread_cond_wait(&doneCond, &mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+// takes stripes until none are left
+void StripePool::work() {
+	pthread_mutex_lock(&mutex);
+	while (next < stripes) {
+		int stripe = next++;
+		Task task = this->task;
+		void* context = this->context;
+		pthread_mutex_unlock(&mutex);
+
+		task(context, stripe);
+
+		pthread_mutex_lock(&mutex);
+		if (--pending == 0) {
+			pthread_cond_signal(&doneCond);
+		}
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+void *StripePool::threadFunc(void *arg) {
+	((StripePool*)arg)->workerLoop();
+	return NULL;
+}
+
+void StripePool::workerLoop() {
+	unsigned int seen = 0;
+	pthread_mutex_lock(&mutex);
+	for (;;) {
+		while (generation == seen && die == 0) {
+			pthread_cond_wait(&startCond, &mutex);
+		}
+		if (die) {
+			break;
+		}
+		seen = generation;
+		pthread_mutex_unlock(&mutex);
+
+		work();
+
+		pthread_mutex_lock(&mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+}
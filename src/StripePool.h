@@ -0,0 +1,49 @@
+//============================================================================
+// Name        : StripePool.h
+// Description : persistent worker threads for processing a frame in stripes
+//============================================================================
+
+#ifndef INCLUDED_StripePool_H
+#define INCLUDED_StripePool_H
+
+#include <vector>
+#include <pthread.h>
+
+/*
+ * runs task(context, stripe) for every stripe of a frame on threads - 1
+ * workers and the calling thread. the workers are started once and sleep
+ * between frames.
+ */
+class StripePool {
+public:
+	typedef void (*Task)(void* context, int stripe);
+
+	StripePool(int threads);
+	~StripePool();
+
+	int getThreads() const { return workers.size() + 1; }
+
+	// returns when all stripes are done
+	void run(Task task, void* context, int stripes);
+
+private:
+	pthread_mutex_t mutex;
+	pthread_cond_t startCond;
+	pthread_cond_t doneCond;
+	std::vector<pthread_t> workers;
+
+	// current frame, guarded by mutex
+	Task task;
+	void* context;
+	int stripes;
+	int next;				// next stripe to take
+	int pending;			// stripes not finished yet
+	unsigned int generation;	// counts run() calls, wakes the workers
+	int die;
+
+	static void *threadFunc(void *arg);
+	void workerLoop();
+	void work();
+};
+
+#endif
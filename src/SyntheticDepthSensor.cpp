@@ -0,0 +1,309 @@
+//============================================================================
+// Name        : SyntheticDepthSensor.cpp
+// Description : renders synthetic table scenes with moving hands
+//============================================================================
+
+#include "SyntheticDepthSensor.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+using namespace std;
+
+static const int frameWidth = 640;
+static const int frameHeight = 480;
+
+// heights above the table (mm)
+static const float tipDown = 14;		// fingertip on the table, inside the default touch band
+static const float tipUp = 45;			// lifted fingertip
+static const float fingerHeight = 45;
+static const float fingerSlope = 1;		// height increase per pixel from the tip towards the palm
+
+// a touching tip covers about 95 pixels inside the default band, twice the
+// default touchMinArea, so the scores measure the pipeline and not the cutoff
+static const float palmHeight = 70;
+static const float armHeight = 110;
+
+// sizes (pixels)
+static const float tipRadius = 5;
+static const float palmRadius = 22;
+static const float armRadius = 18;
+
+static double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+SyntheticDepthSensor::SyntheticDepthSensor(bool realtime)
+	: realtime(realtime)
+	, nFingers(10)
+	, fps(30)
+	, noise(2)
+	, invalid(0.01)
+	, distance(1000)
+	, tilt(0.2)
+	, emptyFrames(30)
+	, nFrames(900)
+	, seed(1)
+	, random(1)
+	, sequence(0)
+	, start(0)
+	, renderTime(0)
+{
+	depth = new uint16_t[frameWidth * frameHeight];
+	heights = new uint16_t[frameWidth * frameHeight];
+}
+
+SyntheticDepthSensor::~SyntheticDepthSensor() {
+	close();
+	delete[] heights;
+	delete[] depth;
+}
+
+int SyntheticDepthSensor::open(const char* config) {
+	// key=value,key=value,...
+	char buffer[256];
+	strncpy(buffer, config, sizeof(buffer) - 1);
+	buffer[sizeof(buffer) - 1] = 0;
+	for (char* token = strtok(buffer, ","); token != NULL; token = strtok(NULL, ",")) {
+		char key[32];
+		double value;
+		if (sscanf(token, "%31[^=]=%lf", key, &value) != 2) {
+			printf("synthetic scene: cannot parse \"%s\"\n", token);
+			return -1;
+		}
+		if (strcmp(key, "fingers") == 0) {
+			nFingers = (int)value;
+		} else if (strcmp(key, "fps") == 0) {
+			fps = value;
+		} else if (strcmp(key, "noise") == 0) {
+			noise = value;
+		} else if (strcmp(key, "invalid") == 0) {
+			invalid = value;
+		} else if (strcmp(key, "distance") == 0) {
+			distance = value;
+		} else if (strcmp(key, "tilt") == 0) {
+			tilt = value;
+		} else if (strcmp(key, "empty") == 0) {
+			emptyFrames = (unsigned int)value;
+		} else if (strcmp(key, "frames") == 0) {
+			nFrames = (unsigned int)value;
+		} else if (strcmp(key, "seed") == 0) {
+			seed = (uint32_t)value;
+		} else {
+			printf("synthetic scene: unknown parameter %s\n", key);
+			return -1;
+		}
+	}
+	if (fps <= 0) {
+		fps = 30;
+	}
+
+	name = config;
+	random = seed ? seed : 1;
+	sequence = 0;
+	renderTime = 0;
+	createHands();
+
+	printf("synthetic scene: %d fingers, %.0f fps, noise %.1f mm, %u frames\n", nFingers, realtime ? fps : 0, noise, nFrames);
+	return 0;
+}
+
+void SyntheticDepthSensor::close() {
+	if (sequence > 0) {
+		printf("synthetic scene %s: %u frames, rendering %.2f ms per frame\n", name.c_str(), sequence, renderTime * 1000 / sequence);
+		sequence = 0;
+	}
+}
+
+int SyntheticDepthSensor::waitFrame(KinnectFrameInfo& info, int timeoutMs) {
+	if (nFrames > 0 && sequence >= nFrames) {
+		return -1;
+	}
+
+	if (realtime) {
+		if (sequence == 0) {
+			start = now();
+		}
+		double wait = start + sequence / fps - now();
+		if (wait * 1000 > timeoutMs) {
+			usleep(timeoutMs * 1000);
+			return 0;
+		}
+		if (wait > 0) {
+			usleep((useconds_t)(wait * 1e6));
+		}
+	}
+
+	double renderStart = now();
+	if (sequence > 0) {
+		moveHands();
+	}
+	render();
+	renderTime += now() - renderStart;
+
+	info.sequence = ++sequence;
+	info.timestamp = (unsigned int)(sequence * 1e6 / fps);
+	info.skipped = 0;
+	return 1;
+}
+
+bool SyntheticDepthSensor::getGroundTruth(vector<GroundTruthTouch>& touches) {
+	touches = truth;
+	return true;
+}
+
+uint32_t SyntheticDepthSensor::nextRandom() {
+	// xorshift32
+	random ^= random << 13;
+	random ^= random >> 17;
+	random ^= random << 5;
+	return random;
+}
+
+float SyntheticDepthSensor::uniform(float a, float b) {
+	return a + (b - a) * (nextRandom() >> 8) * (1.0f / (1 << 24));
+}
+
+void SyntheticDepthSensor::createHands() {
+	hands.clear();
+	for (int remaining = nFingers; remaining > 0; remaining -= 5) {
+		Hand hand;
+		hand.x = uniform(palmRadius, frameWidth - palmRadius);
+		hand.y = uniform(frameHeight / 4, frameHeight - palmRadius);
+		hand.vx = uniform(-2, 2);
+		hand.vy = uniform(-2, 2);
+		hand.armDx = uniform(-80, 80);
+
+		int n = remaining < 5 ? remaining : 5;
+		for (int i = 0; i < n; i++) {
+			Finger finger;
+			finger.angle = -0.9f + 1.8f * (i + 0.5f) / 5 + uniform(-0.1f, 0.1f);
+			finger.length = uniform(40, 55);
+			finger.down = (nextRandom() & 1) != 0;
+			finger.toggle = (int)uniform(15, 90);
+			hand.fingers.push_back(finger);
+		}
+		hands.push_back(hand);
+	}
+}
+
+void SyntheticDepthSensor::moveHands() {
+	for (unsigned int i = 0; i < hands.size(); i++) {
+		Hand& hand = hands[i];
+		hand.x += hand.vx;
+		hand.y += hand.vy;
+		if (hand.x < palmRadius || hand.x > frameWidth - palmRadius) {
+			hand.vx = -hand.vx;
+		}
+		if (hand.y < frameHeight / 4 || hand.y > frameHeight - palmRadius) {
+			hand.vy = -hand.vy;
+		}
+
+		for (unsigned int j = 0; j < hand.fingers.size(); j++) {
+			Finger& finger = hand.fingers[j];
+			if (--finger.toggle <= 0) {
+				finger.down = !finger.down;
+				finger.toggle = (int)uniform(15, 90);
+			}
+		}
+	}
+}
+
+void SyntheticDepthSensor::render() {
+	memset(heights, 0, frameWidth * frameHeight * sizeof(uint16_t));
+	truth.clear();
+
+	if (sequence >= emptyFrames) {
+		for (unsigned int i = 0; i < hands.size(); i++) {
+			const Hand& hand = hands[i];
+			drawCapsule(hand.x, hand.y, hand.x + hand.armDx, frameHeight + 3 * armRadius, armRadius, armHeight, 0, armHeight);
+			drawCapsule(hand.x, hand.y, hand.x, hand.y, palmRadius, palmHeight, 0, palmHeight);
+			for (unsigned int j = 0; j < hand.fingers.size(); j++) {
+				const Finger& finger = hand.fingers[j];
+				float tipX = hand.x + finger.length * sinf(finger.angle);
+				float tipY = hand.y - finger.length * cosf(finger.angle);
+				drawCapsule(tipX, tipY, hand.x, hand.y, tipRadius, finger.down ? tipDown : tipUp, fingerSlope, fingerHeight);
+			}
+		}
+
+		// touching fingertips that are not covered by something higher
+		for (unsigned int i = 0; i < hands.size(); i++) {
+			const Hand& hand = hands[i];
+			for (unsigned int j = 0; j < hand.fingers.size(); j++) {
+				const Finger& finger = hand.fingers[j];
+				GroundTruthTouch touch;
+				touch.x = hand.x + finger.length * sinf(finger.angle);
+				touch.y = hand.y - finger.length * cosf(finger.angle);
+				int x = (int)touch.x, y = (int)touch.y;
+				if (finger.down && x >= 0 && x < frameWidth && y >= 0 && y < frameHeight
+						&& heights[y * frameWidth + x] == (uint16_t)tipDown) {
+					truth.push_back(touch);
+				}
+			}
+		}
+	}
+
+	// table plane + noise (sum of two uniform bytes, standard deviation 104.5)
+	int noiseScale = (int)(noise / 104.5 * 65536);
+	uint32_t invalidThreshold = (uint32_t)(invalid * 65536);
+	for (int y = 0; y < frameHeight; y++) {
+		int plane = (int)(distance + tilt * y);
+		const uint16_t* h = heights + y * frameWidth;
+		uint16_t* d = depth + y * frameWidth;
+		for (int x = 0; x < frameWidth; x++) {
+			uint32_t r = nextRandom();
+			if ((r >> 16) < invalidThreshold) {
+				d[x] = 0;
+				continue;
+			}
+			int n = ((int)(r & 0xff) + (int)((r >> 8) & 0xff) - 255) * noiseScale;
+			d[x] = (uint16_t)(plane - h[x] + ((n + 32768) >> 16));
+		}
+	}
+}
+
+// raises heights inside the capsule around the segment (x0,y0)-(x1,y1) to
+// h0 + slope * (distance from (x0,y0) along the segment), at most hMax
+void SyntheticDepthSensor::drawCapsule(float x0, float y0, float x1, float y1, float radius, float h0, float slope, float hMax) {
+	int left = (int)floorf((x0 < x1 ? x0 : x1) - radius);
+	int right = (int)ceilf((x0 > x1 ? x0 : x1) + radius);
+	int top = (int)floorf((y0 < y1 ? y0 : y1) - radius);
+	int bottom = (int)ceilf((y0 > y1 ? y0 : y1) + radius);
+	if (left < 0) left = 0;
+	if (top < 0) top = 0;
+	if (right > frameWidth - 1) right = frameWidth - 1;
+	if (bottom > frameHeight - 1) bottom = frameHeight - 1;
+
+	float dx = x1 - x0, dy = y1 - y0;
+	float length = sqrtf(dx * dx + dy * dy);
+	if (length > 0) {
+		dx /= length;
+		dy /= length;
+	}
+
+	for (int y = top; y <= bottom; y++) {
+		uint16_t* h = heights + y * frameWidth;
+		for (int x = left; x <= right; x++) {
+			float px = x - x0, py = y - y0;
+			float t = px * dx + py * dy;
+			float tc = t < 0 ? 0 : (t > length ? length : t);
+			float ex = px - tc * dx, ey = py - tc * dy;
+			if (ex * ex + ey * ey > radius * radius) {
+				continue;
+			}
+			float value = h0 + slope * (t > 0 ? t : 0);
+			if (value > hMax) {
+				value = hMax;
+			}
+			if ((uint16_t)value > h[x]) {
+				h[x] = (uint16_t)value;
+			}
+		}
+	}
+}
@@ -0,0 +1,94 @@
+//============================================================================
+// Name        : SyntheticDepthSensor.h
+// Description : renders synthetic table scenes with moving hands
+//============================================================================
+
+#ifndef INCLUDED_SyntheticDepthSensor_H
+#define INCLUDED_SyntheticDepthSensor_H
+
+#include <vector>
+
+#include "DepthSensor.h"
+
+/*
+ * a noisy (slightly tilted) table plane seen from above with hands moving
+ * over it. every hand has an arm reaching in from the bottom edge, a palm
+ * and up to five fingers which tap the table now and then. the fingertips
+ * touching the table and not hidden under another hand are reported as
+ * ground truth, so the detection can be scored against it.
+ *
+ * the scene is configured by the string passed to open(), a comma
+ * separated list of key=value pairs (missing keys keep their default):
+ *   fingers=10		number of fingers (5 per hand)
+ *   fps=30			frame rate (ignored if realtime is false)
+ *   noise=2		standard deviation of the depth noise (mm)
+ *   invalid=0.01	fraction of pixels without depth
+ *   distance=1000	distance of the table at the top of the frame (mm)
+ *   tilt=0.2		depth increase per row (mm)
+ *   empty=30		frames without hands at the start (background training)
+ *   frames=900		frames to deliver (0: forever)
+ *   seed=1			random seed
+ */
+class SyntheticDepthSensor : public DepthSensor {
+public:
+	SyntheticDepthSensor(bool realtime = true);
+	~SyntheticDepthSensor();
+
+	int open(const char* config);
+	void close();
+
+	int waitFrame(KinnectFrameInfo& info, int timeoutMs);
+	uint16_t* getDepthMap() { return depth; }
+
+	bool getGroundTruth(std::vector<GroundTruthTouch>& touches);
+
+	const std::string& getSerial() const { return name; }
+
+private:
+	struct Finger {
+		float angle;		// direction from the palm (radians, 0 is up)
+		float length;
+		bool down;			// touching the table
+		int toggle;			// frames until the finger is lifted or put down
+	};
+
+	struct Hand {
+		float x, y;			// palm center (pixels)
+		float vx, vy;		// pixels per frame
+		float armDx;		// horizontal offset of the arm at the bottom edge
+		std::vector<Finger> fingers;
+	};
+
+	bool realtime;
+	std::string name;
+
+	// scene parameters
+	int nFingers;
+	double fps;
+	double noise;
+	double invalid;
+	double distance;
+	double tilt;
+	unsigned int emptyFrames;
+	unsigned int nFrames;
+	uint32_t seed;
+
+	uint32_t random;			// xorshift state
+	std::vector<Hand> hands;
+	std::vector<GroundTruthTouch> truth;
+	uint16_t* depth;
+	uint16_t* heights;			// height above the table of the current frame (mm)
+
+	unsigned int sequence;
+	double start;				// wall time of the first frame
+	double renderTime;			// seconds spent rendering
+
+	uint32_t nextRandom();
+	float uniform(float a, float b);
+	void createHands();
+	void moveHands();
+	void render();
+	void drawCapsule(float x0, float y0, float x1, float y1, float radius, float h0, float slope, float hMax);
+};
+
+#endif
@@ -0,0 +1,421 @@
+//============================================================================
+// Name        : TouchDetector.cpp
+// Description : finds touch points in a depth frame by comparing it with a
+//				 background model of the empty surface
+//============================================================================
+
+#include "TouchDetector.h"
+#include "TouchKernels.h"
+#include "BackgroundModel.h"
+
+#include <math.h>
+#include <algorithm>
+
+using namespace std;
+using namespace cv;
+
+// border (in full resolution pixels) added around each candidate blob in pyramid mode
+static const int windowMargin = 4;
+
+TouchDetector::TouchDetector(int width, int height)
+	: touchDepthMin(10)
+	, touchDepthMax(20)
+	, touchMinArea(50)
+	, noiseFactor(3)
+	, roi(0, 0, width, height)
+	, pyramid(false)
+	, openMask(false)
+	, closeMask(false)
+	, skipUnchanged(false)
+	, background(height, width, (short)0)
+	, stddev(height, width, 0.0f)
+	, bandNear(height, width)
+	, bandFar(height, width)
+	, bandLower(height, width)
+	, bandUpper(height, width)
+	, bandDepthMin(-1)
+	, bandDepthMax(-1)
+	, bandNoiseFactor(-1)
+	, wordsPerRow(width / 64)
+	, touch(wordsPerRow * height, 0)
+	, filtered(wordsPerRow * height, 0)
+	, coarse(wordsPerRow / 2 * height / 2, 0)
+	, pool(NULL)
+	, stripeDepth(NULL)
+	, stripeValid(NULL)
+	, stripeStep(0)
+	, thresholded(wordsPerRow * height, 0)
+	, lastSteps(-1)
+{
+}
+
+TouchDetector::~TouchDetector() {
+	delete pool;
+}
+
+void TouchDetector::setThreads(int threads) {
+	delete pool;
+	pool = NULL;
+	stripeLabellers.clear();
+	stripeChanged.clear();
+	if (threads > 1) {
+		pool = new StripePool(threads);
+		stripeLabellers.resize(pool->getThreads());
+		stripeChanged.resize(pool->getThreads());
+	}
+}
+
+void TouchDetector::setBackground(const Mat1s& background, const Mat1f& stddev) {
+	this->background = background;
+	stddev.copyTo(this->stddev);
+	updateBands();
+}
+
+void TouchDetector::backgroundChanged() {
+	moveBands();
+}
+
+void TouchDetector::updateBands() {
+	bandDepthMin = touchDepthMin;
+	bandDepthMax = touchDepthMax;
+	bandNoiseFactor = noiseFactor;
+	bandRoi = roi;
+
+	// nothing outside the roi is ever thresholded
+	for (int y = roi.y; y < roi.y + roi.height; y++) {
+		const float* s = stddev[y];
+		short* lower = bandLower[y];
+		short* upper = bandUpper[y];
+		for (int x = roi.x; x < roi.x + roi.width; x++) {
+			int l = (int)ceilf(noiseFactor * s[x]);
+			if (l < touchDepthMin) {
+				l = touchDepthMin;
+			}
+			lower[x] = l;
+			upper[x] = touchDepthMax + l - touchDepthMin;
+		}
+	}
+	moveBands();
+}
+
+// bands of the current background
+void TouchDetector::moveBands() {
+	for (int y = bandRoi.y; y < bandRoi.y + bandRoi.height; y++) {
+		const short* b = background[y];
+		const short* lower = bandLower[y];
+		const short* upper = bandUpper[y];
+		short* near = bandNear[y];
+		short* far = bandFar[y];
+		for (int x = bandRoi.x; x < bandRoi.x + bandRoi.width; x++) {
+			near[x] = b[x] != 0 ? b[x] - upper[x] : 0;	// unknown background: empty band
+			far[x] = b[x] != 0 ? b[x] - lower[x] : 0;
+		}
+	}
+}
+
+void TouchDetector::adaptBackground(const uint16_t* depth, uint16_t invalidDepth, int y, int x0, int x1) {
+	if (y < bandRoi.y || y >= bandRoi.y + bandRoi.height) {
+		return;
+	}
+	x0 = max(x0, bandRoi.x);
+	x1 = min(x1, bandRoi.x + bandRoi.width);
+	if (x0 >= x1) {
+		return;
+	}
+	const int offset = y * background.cols + x0;
+	adaptBackgroundBands((int16_t*)background[y] + x0, depth + offset, invalidDepth, touchDepthMin,
+			bandLower[y] + x0, bandUpper[y] + x0, bandNear[y] + x0, bandFar[y] + x0, x1 - x0);
+}
+
+// bits of word k inside the window
+static inline uint64_t windowBits(int k, const Rect& window) {
+	uint64_t inside = ~0ull;
+	if (k * 64 < window.x) {
+		inside &= ~0ull << (window.x - k * 64);
+	}
+	if ((k + 1) * 64 > window.x + window.width) {
+		inside &= ~0ull >> ((k + 1) * 64 - window.x - window.width);
+	}
+	return inside;
+}
+
+// the unfiltered mask: touch, or thresholded if the filters have to keep
+// it for the comparison with the next frame
+uint64_t* TouchDetector::getThresholdTarget() {
+	return skipUnchanged && !pyramid && getFilterSteps(NULL) > 0 ? &thresholded[0] : &touch[0];
+}
+
+// touch = bandNear < depth < bandFar. runs of 64 pixels without a reading
+// (valid mask word 0, e.g. shadows) are cleared without looking at them.
+// bits of the words outside the window are kept. returns true if a bit
+// inside the window changed.
+bool TouchDetector::thresholdWindow(const Mat1s& depth, const uint64_t* valid, const Rect& window) {
+	const int k0 = window.x / 64, k1 = (window.x + window.width + 63) / 64;
+	uint64_t* target = getThresholdTarget();
+	uint64_t changed = 0;
+	for (int y = window.y; y < window.y + window.height; y++) {
+		const short* d = depth[y];
+		const short* near = bandNear[y];
+		const short* far = bandFar[y];
+		uint64_t* t = target + y * wordsPerRow;
+		const uint64_t* v = valid + y * wordsPerRow;
+		for (int k = k0; k < k1; k++) {
+			uint64_t bits = 0;
+			if (v[k] != 0) {
+				thresholdBandBits(d + k * 64, near + k * 64, far + k * 64, &bits, 1);
+				bits &= v[k];
+			}
+			uint64_t inside = windowBits(k, window);
+			changed |= (t[k] ^ bits) & inside;
+			t[k] = (t[k] & ~inside) | (bits & inside);
+		}
+	}
+	return changed != 0;
+}
+
+void TouchDetector::getTouchMask(Mat1b& mask) const {
+	mask.create(touch.size() / wordsPerRow, wordsPerRow * 64);
+	unpackMask(&touch[0], mask[0], mask.rows * mask.cols);
+}
+
+void TouchDetector::detect(const Mat1s& depth, const uint64_t* valid, vector<Point2f>& touchPoints) {
+	// thresholds or roi changed (trackbars)
+	if (touchDepthMin != bandDepthMin || touchDepthMax != bandDepthMax || noiseFactor != bandNoiseFactor || roi != bandRoi) {
+		updateBands();
+	}
+
+	touchPoints.clear();
+
+	if (!pyramid) {
+		bool thresholded = false;
+		if (skipUnchanged) {
+			// the mask of the last frame can only be compared if it was made the same way
+			const int steps = getFilterSteps(NULL);
+			const bool compare = steps == lastSteps && roi == lastRoi;
+			lastSteps = steps;
+			lastRoi = roi;
+			bool changed = pool ? thresholdStripes(depth, valid) : thresholdWindow(depth, valid, roi);
+			if (compare && !changed && touchBlobs.empty()) {
+				return;		// same mask as in the last frame, still no touches
+			}
+			thresholded = true;
+		} else {
+			lastSteps = -1;
+		}
+		touchBlobs.clear();
+		if (pool) {
+			segmentStripes(depth, valid, thresholded, touchPoints);
+		} else {
+			if (!thresholded) {
+				thresholdWindow(depth, valid, roi);
+			}
+			filterWindow(roi);
+			findTouchPoints(depth, roi, touchPoints);
+		}
+		return;
+	}
+
+	lastSteps = -1;
+	touchBlobs.clear();
+
+	findWindows(depth);
+
+	fill(touch.begin(), touch.end(), 0);
+	for (unsigned int i = 0; i < windows.size(); i++) {
+		thresholdWindow(depth, valid, windows[i]);
+		filterWindow(windows[i]);
+		findTouchPoints(depth, windows[i], touchPoints);
+	}
+}
+
+// pixels without a reading (0) or without background (band 0, 0) never count
+bool TouchDetector::findForeground(const Mat1s& depth, int step, int minPixels) const {
+	int count = 0;
+	for (int y = roi.y; y < roi.y + roi.height; y += step) {
+		const short* d = depth[y];
+		const short* far = bandFar[y];
+		for (int x = roi.x; x < roi.x + roi.width; x += step) {
+			count += d[x] > 0 && d[x] < far[x];
+		}
+		if (count >= minPixels) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// rows [y0, y1) of the roi for stripe s of n
+static void stripeRows(const Rect& roi, int s, int n, int& y0, int& y1) {
+	y0 = roi.y + roi.height * s / n;
+	y1 = roi.y + roi.height * (s + 1) / n;
+}
+
+void TouchDetector::thresholdStripe(void* detector, int stripe) {
+	TouchDetector* d = (TouchDetector*)detector;
+	int y0, y1;
+	stripeRows(d->roi, stripe, d->stripeLabellers.size(), y0, y1);
+	d->stripeChanged[stripe] = d->thresholdWindow(*d->stripeDepth, d->stripeValid, Rect(d->roi.x, y0, d->roi.width, y1 - y0));
+}
+
+void TouchDetector::filterStripe(void* detector, int stripe) {
+	TouchDetector* d = (TouchDetector*)detector;
+	int y0, y1;
+	stripeRows(d->roi, stripe, d->stripeLabellers.size(), y0, y1);
+	d->filterStep(d->stripeStep, d->roi, y0, y1);
+}
+
+void TouchDetector::labelStripe(void* detector, int stripe) {
+	TouchDetector* d = (TouchDetector*)detector;
+	int y0, y1;
+	stripeRows(d->roi, stripe, d->stripeLabellers.size(), y0, y1);
+	RunLabeller& labeller = d->stripeLabellers[stripe];
+	labeller.reset();
+	labeller.scan(&d->touch[0], d->wordsPerRow, d->roi.x, y0, d->roi.width, y1 - y0,
+			(*d->stripeDepth)[0], d->stripeDepth->cols, d->bandNear[0]);
+}
+
+void TouchDetector::segmentStripe(void* detector, int stripe) {
+	thresholdStripe(detector, stripe);
+	labelStripe(detector, stripe);
+}
+
+// threshold of the stripes in parallel, true if a bit of the mask changed
+bool TouchDetector::thresholdStripes(const Mat1s& depth, const uint64_t* valid) {
+	stripeDepth = &depth;
+	stripeValid = valid;
+	pool->run(thresholdStripe, this, stripeLabellers.size());
+	return find(stripeChanged.begin(), stripeChanged.end(), 1) != stripeChanged.end();
+}
+
+// threshold (unless thresholdStripes did it) and labelling of the stripes in
+// parallel, then the blobs crossing stripe borders are joined. the filter
+// steps need the rows of the neighbouring stripes, every step waits for the
+// previous one.
+void TouchDetector::segmentStripes(const Mat1s& depth, const uint64_t* valid, bool thresholded, vector<Point2f>& touchPoints) {
+	stripeDepth = &depth;
+	stripeValid = valid;
+	int stripes = stripeLabellers.size();
+	int steps = getFilterSteps(NULL);
+	if (steps == 0 && !thresholded) {
+		pool->run(segmentStripe, this, stripes);
+	} else {
+		if (!thresholded) {
+			pool->run(thresholdStripe, this, stripes);
+		}
+		for (stripeStep = 0; stripeStep < steps; stripeStep++) {
+			pool->run(filterStripe, this, stripes);
+		}
+		pool->run(labelStripe, this, stripes);
+	}
+
+	labeller.reset();
+	for (unsigned int i = 0; i < stripeLabellers.size(); i++) {
+		labeller.append(stripeLabellers[i]);
+	}
+	labeller.finish();
+	collectTouchPoints(touchPoints);
+}
+
+//---------------------------------------------------------------------------
+// open / close
+//---------------------------------------------------------------------------
+
+// the erosions (false) and dilations (true) of the filter, returns their number
+int TouchDetector::getFilterSteps(bool* dilate) const {
+	bool steps[4];
+	int n = 0;
+	if (openMask) {
+		steps[n++] = false;
+		steps[n++] = true;
+	}
+	if (closeMask) {
+		steps[n++] = true;
+		steps[n++] = false;
+	}
+	for (int i = 0; dilate && i < n; i++) {
+		dilate[i] = steps[i];
+	}
+	return n;
+}
+
+// the steps go from touch to filtered and back, an even number ends in
+// touch. the first one reads the unfiltered mask.
+void TouchDetector::filterStep(int step, const Rect& window, int row0, int row1) {
+	bool dilate[4];
+	getFilterSteps(dilate);
+	const uint64_t* in = step == 0 ? getThresholdTarget() : step % 2 == 0 ? &touch[0] : &filtered[0];
+	uint64_t* out = step % 2 == 0 ? &filtered[0] : &touch[0];
+	morphMask(in, out, wordsPerRow, window.x, window.y, window.width, window.height, row0, row1, dilate[step]);
+}
+
+void TouchDetector::filterWindow(const Rect& window) {
+	int steps = getFilterSteps(NULL);
+	for (int i = 0; i < steps; i++) {
+		filterStep(i, window, window.y, window.y + window.height);
+	}
+}
+
+void TouchDetector::findTouchPoints(const Mat1s& depth, const Rect& window, vector<Point2f>& touchPoints) {
+	// タッチ位置を探す
+	labeller.label(&touch[0], wordsPerRow, window.x, window.y, window.width, window.height, depth[0], depth.cols, bandNear[0]);
+	collectTouchPoints(touchPoints);
+}
+
+void TouchDetector::collectTouchPoints(vector<Point2f>& touchPoints) {
+	const vector<MaskBlob>& blobs = labeller.getBlobs();
+	for (unsigned int i = 0; i < blobs.size(); i++) {
+		// find touch points by area thresholding
+		if (blobs[i].area > touchMinArea) {	// 小さすぎる点はタッチと見なさない
+			touchPoints.push_back(Point2f(blobs[i].wx, blobs[i].wy));
+			touchBlobs.push_back(blobs[i]);
+		}
+	}
+}
+
+// thresholds every 4th pixel of the roi and returns the full resolution
+// windows around the candidate blobs found in that coarse mask
+void TouchDetector::findWindows(const Mat1s& depth) {
+	const int x0 = (roi.x + 1) / 2, x1 = (roi.x + roi.width) / 2;
+	const int y0 = (roi.y + 1) / 2, y1 = (roi.y + roi.height) / 2;
+
+	const int coarseWords = wordsPerRow / 2;
+
+	for (int y = y0; y < y1; y++) {
+		const short* d = depth[2 * y];
+		const short* near = bandNear[2 * y];
+		const short* far = bandFar[2 * y];
+		uint64_t* c = &coarse[y * coarseWords];
+		for (int k = 0; k < coarseWords; k++) {
+			c[k] = 0;
+		}
+		for (int x = x0; x < x1; x++) {
+			c[x / 64] |= (uint64_t)(d[2 * x] > near[2 * x] && d[2 * x] < far[2 * x]) << (x % 64);
+		}
+	}
+
+	labeller.label(&coarse[0], coarseWords, x0, y0, x1 - x0, y1 - y0);
+	const vector<MaskBlob>& blobs = labeller.getBlobs();
+
+	windows.clear();
+	for (unsigned int i = 0; i < blobs.size(); i++) {
+		Rect r(blobs[i].x0, blobs[i].y0, blobs[i].x1 - blobs[i].x0, blobs[i].y1 - blobs[i].y0);
+		Rect w(2 * r.x - windowMargin, 2 * r.y - windowMargin, 2 * r.width + 2 * windowMargin, 2 * r.height + 2 * windowMargin);
+		windows.push_back(w & roi);
+	}
+
+	// merge overlapping windows, otherwise a blob would be reported twice
+	bool merged = true;
+	while (merged) {
+		merged = false;
+		for (unsigned int i = 0; i < windows.size() && !merged; i++) {
+			for (unsigned int j = i + 1; j < windows.size(); j++) {
+				if ((windows[i] & windows[j]).area() > 0) {
+					windows[i] = windows[i] | windows[j];
+					windows.erase(windows.begin() + j);
+					merged = true;
+					break;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,173 @@
+//============================================================================
+// Name        : TouchDetector.h
+// Description : finds touch points in a depth frame by comparing it with a
+//				 background model of the empty surface
+//============================================================================
+
+#ifndef INCLUDED_TouchDetector_H
+#define INCLUDED_TouchDetector_H
+
+#include <vector>
+#include <stdint.h>
+
+#include <opencv/cv.h>
+
+#include "RunLabeller.h"
+#include "StripePool.h"
+
+class TouchDetector {
+public:
+	int touchDepthMin;	// タッチ判定の最小値 (height above the background, mm)
+	int touchDepthMax;	// タッチ判定の最大値
+	int touchMinArea;	// このエリアよりも輪郭が大きいなら、タッチ箇所とみなす
+
+	/*
+	 * noisy pixels get a higher band: it starts noiseFactor standard
+	 * deviations above the background if that is more than touchDepthMin,
+	 * and keeps its width.
+	 */
+	float noiseFactor;
+
+	cv::Rect roi;		// only touches inside this rectangle are reported
+
+	/*
+	 * coarse to fine mode: candidate blobs are searched on every second pixel
+	 * of every second row first, the exact threshold and contours are then
+	 * only computed in full resolution windows around those candidates.
+	 */
+	bool pyramid;
+
+	/*
+	 * 3x3 morphological filters of the touch mask before labelling:
+	 * opening removes specks and thin noise, closing fills pinholes and
+	 * small gaps. opening goes first if both are enabled. opening also
+	 * thins narrow blobs, touchMinArea may have to be lowered with it.
+	 */
+	bool openMask;
+	bool closeMask;
+
+	/*
+	 * the roi is thresholded every frame and compared with the unfiltered
+	 * mask of the previous one. if it is the same and had no touches (an
+	 * empty table, maybe with a few specks) filtering and labelling are
+	 * skipped. touches are always labelled again, their centers are
+	 * weighted by depth. any change filters and labels the whole roi. the
+	 * touch points are the same as without. not used in pyramid mode.
+	 */
+	bool skipUnchanged;
+
+	TouchDetector(int width = 640, int height = 480);
+	~TouchDetector();
+
+	/*
+	 * splits threshold and labelling of the roi into horizontal stripes
+	 * processed by that many threads (1: all on the calling thread). the
+	 * blobs are merged at the stripe borders, the touch points are the same
+	 * for any number of threads. pyramid mode always uses one thread.
+	 */
+	void setThreads(int threads);
+
+	/*
+	 * sets the background model and the standard deviation of every
+	 * background pixel. background is not copied, call backgroundChanged()
+	 * after modifying it.
+	 */
+	void setBackground(const cv::Mat1s& background, const cv::Mat1f& stddev);
+	void backgroundChanged();
+
+	/*
+	 * adapts the background in row y from x0 to x1 (see adaptBackground)
+	 * and moves the touch bands of those pixels in the same pass, no
+	 * backgroundChanged() needed. only pixels inside the roi are adapted.
+	 */
+	void adaptBackground(const uint16_t* depth, uint16_t invalidDepth, int y, int x0, int x1);
+
+	/*
+	 * finds touch points in depth. valid is the validity mask of the frame
+	 * (see buildValidMask), the width of depth must be a multiple of 64
+	 * (of 128 in pyramid mode). a touch point is the sub-pixel center of its
+	 * blob, every pixel weighted by its distance from the near end of the
+	 * band, so the pixels closest to the surface count most.
+	 */
+	void detect(const cv::Mat1s& depth, const uint64_t* valid, std::vector<cv::Point2f>& touchPoints);
+
+	/*
+	 * true if at least minPixels pixels of every step-th row and column of
+	 * the roi are nearer than the far end of their touch band, i.e. a hand
+	 * is touching or hovering. a quick check for frames that are not
+	 * detected.
+	 */
+	bool findForeground(const cv::Mat1s& depth, int step, int minPixels) const;
+
+	// blobs of the touch points of the last frame (same order)
+	const std::vector<MaskBlob>& getTouchBlobs() const { return touchBlobs; }
+
+	/*
+	 * touch mask of the last frame, one bit per pixel (see RunLabeller).
+	 * only valid inside the searched windows in pyramid mode.
+	 */
+	const uint64_t* getTouchBits() const { return &touch[0]; }
+	void getTouchMask(cv::Mat1b& mask) const;	// 0/255 per pixel
+
+private:
+	/*
+	 * per pixel touch band in depth units: a pixel is touched if
+	 * bandNear < depth < bandFar, which needs no subtraction per frame.
+	 * pixels without background have an empty band. only computed inside
+	 * the roi. bandLower/bandUpper are the offsets of the band below the
+	 * background, they only change with stddev and the thresholds.
+	 */
+	cv::Mat1s background;
+	cv::Mat1f stddev;
+	cv::Mat1s bandNear, bandFar;
+	cv::Mat1s bandLower, bandUpper;
+	int bandDepthMin, bandDepthMax;	// parameters the bands were computed with
+	float bandNoiseFactor;
+	cv::Rect bandRoi;
+
+	int wordsPerRow;
+	std::vector<uint64_t> touch;	// touch mask, 64 pixels per word
+	std::vector<uint64_t> filtered;	// touch mask between two filter steps
+	std::vector<uint64_t> coarse;	// touch candidates at half resolution
+	RunLabeller labeller;
+	std::vector<MaskBlob> touchBlobs;
+
+	StripePool* pool;		// NULL with one thread
+	std::vector<RunLabeller> stripeLabellers;
+	std::vector<uint8_t> stripeChanged;	// thresholdWindow() result of every stripe
+	const cv::Mat1s* stripeDepth;	// frame being segmented by the stripes
+	const uint64_t* stripeValid;
+	int stripeStep;					// filter step of filterStripe
+	std::vector<cv::Rect> windows;
+
+	/*
+	 * skipUnchanged: thresholded keeps the unfiltered mask of the previous
+	 * frame when the filters are on. it can only be compared if it was
+	 * made with the same filters and roi (lastSteps -1: no mask).
+	 */
+	std::vector<uint64_t> thresholded;
+	int lastSteps;
+	cv::Rect lastRoi;
+
+	TouchDetector(const TouchDetector&);
+	TouchDetector& operator=(const TouchDetector&);
+
+	void findTouchPoints(const cv::Mat1s& depth, const cv::Rect& window, std::vector<cv::Point2f>& touchPoints);
+	void collectTouchPoints(std::vector<cv::Point2f>& touchPoints);
+	bool thresholdStripes(const cv::Mat1s& depth, const uint64_t* valid);
+	void segmentStripes(const cv::Mat1s& depth, const uint64_t* valid, bool thresholded, std::vector<cv::Point2f>& touchPoints);
+	static void segmentStripe(void* detector, int stripe);
+	static void thresholdStripe(void* detector, int stripe);
+	static void filterStripe(void* detector, int stripe);
+	static void labelStripe(void* detector, int stripe);
+	int getFilterSteps(bool* dilate) const;
+	void filterStep(int step, const cv::Rect& window, int row0, int row1);
+	void filterWindow(const cv::Rect& window);
+	void findWindows(const cv::Mat1s& depth);
+	void updateBands();
+	void moveBands();
+	bool thresholdWindow(const cv::Mat1s& depth, const uint64_t* valid, const cv::Rect& window);
+	uint64_t* getThresholdTarget();
+};
+
+#endif
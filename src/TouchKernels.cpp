@@ -0,0 +1,178 @@
+//============================================================================
+// Name        : TouchKernels.cpp
+// Description : per pixel kernels of the touch segmentation
+//============================================================================
+
+#include "TouchKernels.h"
+
+#include <string.h>
+
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define TOUCH_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+//---------------------------------------------------------------------------
+// band threshold to a bit mask
+//---------------------------------------------------------------------------
+
+static void thresholdBitsPlain(const int16_t* depth, const int16_t* near, const int16_t* far, uint64_t* touch, int words) {
+	for (int k = 0; k < words; k++) {
+		uint64_t word = 0;
+		for (int b = 0; b < 64; b++) {
+			int i = k * 64 + b;
+			word |= (uint64_t)((depth[i] > near[i]) & (depth[i] < far[i])) << b;
+		}
+		touch[k] = word;
+	}
+}
+
+#ifdef TOUCH_X86_SIMD
+// the packed 0/-1 bytes of the compares go through movemask, one bit per pixel
+__attribute__((target("sse2")))
+static void thresholdBitsSSE2(const int16_t* depth, const int16_t* near, const int16_t* far, uint64_t* touch, int words) {
+	for (int k = 0; k < words; k++) {
+		uint64_t word = 0;
+		for (int b = 0; b < 64; b += 16) {
+			int i = k * 64 + b;
+			__m128i d0 = _mm_loadu_si128((const __m128i*)(depth + i));
+			__m128i d1 = _mm_loadu_si128((const __m128i*)(depth + i + 8));
+			__m128i t0 = _mm_and_si128(_mm_cmpgt_epi16(d0, _mm_loadu_si128((const __m128i*)(near + i))),
+					_mm_cmplt_epi16(d0, _mm_loadu_si128((const __m128i*)(far + i))));
+			__m128i t1 = _mm_and_si128(_mm_cmpgt_epi16(d1, _mm_loadu_si128((const __m128i*)(near + i + 8))),
+					_mm_cmplt_epi16(d1, _mm_loadu_si128((const __m128i*)(far + i + 8))));
+			word |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_packs_epi16(t0, t1)) << b;
+		}
+		touch[k] = word;
+	}
+}
+
+__attribute__((target("avx2")))
+static void thresholdBitsAVX2(const int16_t* depth, const int16_t* near, const int16_t* far, uint64_t* touch, int words) {
+	for (int k = 0; k < words; k++) {
+		uint64_t word = 0;
+		for (int b = 0; b < 64; b += 32) {
+			int i = k * 64 + b;
+			__m256i d0 = _mm256_loadu_si256((const __m256i*)(depth + i));
+			__m256i d1 = _mm256_loadu_si256((const __m256i*)(depth + i + 16));
+			__m256i t0 = _mm256_and_si256(_mm256_cmpgt_epi16(_mm256_loadu_si256((const __m256i*)(far + i)), d0),
+					_mm256_cmpgt_epi16(d0, _mm256_loadu_si256((const __m256i*)(near + i))));
+			__m256i t1 = _mm256_and_si256(_mm256_cmpgt_epi16(_mm256_loadu_si256((const __m256i*)(far + i + 16)), d1),
+					_mm256_cmpgt_epi16(d1, _mm256_loadu_si256((const __m256i*)(near + i + 16))));
+			__m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(t0, t1), 0xd8);
+			word |= (uint64_t)(uint32_t)_mm256_movemask_epi8(packed) << b;
+		}
+		touch[k] = word;
+	}
+}
+#endif
+
+//---------------------------------------------------------------------------
+// morphology on bit masks
+//---------------------------------------------------------------------------
+
+// bits of word k inside the pixels [x0, x1)
+static inline uint64_t insideBits(int k, int x0, int x1) {
+	uint64_t bits = ~0ull;
+	if (k * 64 < x0) {
+		bits &= ~0ull << (x0 - k * 64);
+	}
+	if ((k + 1) * 64 > x1) {
+		bits &= ~0ull >> ((k + 1) * 64 - x1);
+	}
+	return bits;
+}
+
+// the 1x3 erosion or dilation of word k of a row, in holds the words k0 - 1 .. k1 of it
+static inline uint64_t morphRow(const uint64_t* in, int k, bool dilate) {
+	uint64_t c = in[k];
+	uint64_t left = (c << 1) | (in[k - 1] >> 63);		// neighbour at x - 1
+	uint64_t right = (c >> 1) | (in[k + 1] << 63);		// neighbour at x + 1
+	return dilate ? (c | left | right) : (c & left & right);
+}
+
+void morphMask(const uint64_t* in, uint64_t* out, int wordsPerRow, int x, int y, int width, int height,
+		int row0, int row1, bool dilate) {
+	const int k0 = x / 64, k1 = (x + width + 63) / 64;
+	const int words = k1 - k0;
+
+	// one row of the window with a zero word on both sides, nothing outside the window
+	vector<uint64_t> row(words + 2, 0);
+	// 1x3 results of the rows above, at and below the current one
+	vector<uint64_t> lines(3 * (words + 2), 0);
+	uint64_t* line[3] = { &lines[0], &lines[words + 2], &lines[2 * (words + 2)] };
+
+	for (int r = row0 - 1; r <= row1; r++) {
+		// rotate, the new row goes to line[2]
+		uint64_t* oldest = line[0];
+		line[0] = line[1];
+		line[1] = line[2];
+		line[2] = oldest;
+		if (r < y || r >= y + height) {
+			for (int i = 1; i <= words; i++) {
+				line[2][i] = 0;
+			}
+		} else {
+			const uint64_t* m = in + r * wordsPerRow;
+			for (int k = k0; k < k1; k++) {
+				row[k - k0 + 1] = m[k] & insideBits(k, x, x + width);
+			}
+			for (int i = 1; i <= words; i++) {
+				line[2][i] = morphRow(&row[0], i, dilate);
+			}
+		}
+		if (r < row0 + 1) {
+			continue;	// line[1] is not a row to compute yet
+		}
+
+		uint64_t* o = out + (r - 1) * wordsPerRow;
+		for (int k = k0; k < k1; k++) {
+			int i = k - k0 + 1;
+			uint64_t bits = dilate ? (line[0][i] | line[1][i] | line[2][i])
+					: (line[0][i] & line[1][i] & line[2][i]);
+			uint64_t inside = insideBits(k, x, x + width);
+			o[k] = (o[k] & ~inside) | (bits & inside);
+		}
+	}
+}
+
+static ThresholdBitsFunc selectThresholdBits() {
+#ifdef TOUCH_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return thresholdBitsAVX2;
+	if (__builtin_cpu_supports("sse2")) return thresholdBitsSSE2;
+#endif
+	return thresholdBitsPlain;
+}
+
+static const ThresholdBitsFunc thresholdBits = selectThresholdBits();
+
+void thresholdBandBits(const int16_t* depth, const int16_t* near, const int16_t* far, uint64_t* touch, int words) {
+	thresholdBits(depth, near, far, touch, words);
+}
+
+void unpackMask(const uint64_t* bits, uint8_t* mask, int n) {
+	for (int i = 0; i < n; i++) {
+		mask[i] = (uint8_t)-(int)((bits[i / 64] >> (i % 64)) & 1);
+	}
+}
+
+ThresholdBitsFunc getThresholdBandBits(const char* name) {
+	if (strcmp(name, "scalar") == 0) {
+		return thresholdBitsPlain;
+	}
+#ifdef TOUCH_X86_SIMD
+	__builtin_cpu_init();
+	if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+		return thresholdBitsSSE2;
+	}
+	if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+		return thresholdBitsAVX2;
+	}
+#endif
+	return NULL;
+}
@@ -0,0 +1,37 @@
+//============================================================================
+// Name        : TouchKernels.h
+// Description : per pixel kernels of the touch segmentation
+//============================================================================
+
+#ifndef INCLUDED_TouchKernels_H
+#define INCLUDED_TouchKernels_H
+
+#include <stdint.h>
+
+typedef void (*ThresholdBitsFunc)(const int16_t* depth, const int16_t* near, const int16_t* far, uint64_t* touch, int words);
+
+/*
+ * bit i % 64 of touch[i / 64] is set if near[i] < depth[i] < far[i]
+ * (touched). converts words * 64 pixels, reads every input once and writes
+ * the mask directly, no temporaries. uses AVX2 or SSE2 when the cpu
+ * supports it.
+ */
+void thresholdBandBits(const int16_t* depth, const int16_t* near, const int16_t* far, uint64_t* touch, int words);
+
+// bit mask to 0/255 bytes (n multiple of 64)
+void unpackMask(const uint64_t* bits, uint8_t* mask, int n);
+
+/*
+ * 3x3 erosion (dilate false) or dilation of a bit mask (wordsPerRow words
+ * per row) inside the window (x, y, width, height): pixels outside the
+ * window count as 0. computes rows [row0, row1) of the window into out,
+ * bits of out outside the window are kept. in and out must differ. works
+ * on 64 pixels per operation.
+ */
+void morphMask(const uint64_t* in, uint64_t* out, int wordsPerRow, int x, int y, int width, int height,
+		int row0, int row1, bool dilate);
+
+// a single implementation ("scalar", "sse2", "avx2"), NULL if the cpu lacks it. for benchmarks.
+ThresholdBitsFunc getThresholdBandBits(const char* name);
+
+#endif
@@ -0,0 +1,470 @@
+//============================================================================
+// Name        : TouchSensor.cpp
+// Description : capture and segmentation thread of one depth sensor
+//============================================================================
+
+#include "TouchSensor.h"
+#include "DepthConvert.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <opencv/highgui.h>
+
+using namespace std;
+using namespace cv;
+
+static const int frameTimeout = 100;			// max. time (ms) to wait for a new depth frame
+static const unsigned int statsInterval = 300;	// print frame statistics every n frames
+static const float snapshotMaxChanged = 0.05;	// retrain if more pixels than this differ from the snapshot
+static const float truthRadius = 10;			// max. distance (pixels) of a detected touch from the true one
+static const int idleGridStep = 4;				// foreground check of idle frames on every n-th row and column
+static const int idleWakePixels = 4;			// grid pixels in front of the surface that end the idle mode
+
+static const double debugFrameMaxDepth = 4000;	// maximal distance (in millimeters) for 8 bit debug depth frame quantization. 4000mm === 4m
+static const Scalar debugColor0(0, 0, 128);		// タッチ近似領域の色：Scalr(Blue, Green, Red) === (0x800000) === red
+static const Scalar debugColor1(255, 0, 0);		// ROIを囲む枠線の色
+static const Scalar debugColor2(255, 255, 255);	// タッチの色
+
+TouchSensor::TouchSensor(DepthSensor* sensor, unsigned int nBackgroundTrain)
+	: detector(640, 480)
+	, activeArea(640, 480)
+	, surfaceX0(0), surfaceY0(0), surfaceX1(1), surfaceY1(1)
+	, debugEnabled(true)
+	, recorder(NULL)
+	, adaptInterval(4)
+	, holeFill(0)
+	, robustTraining(false)
+	, idleSeconds(0)
+	, idleStride(6)
+	, sensor(sensor)
+	, nBackgroundTrain(nBackgroundTrain)
+	, die(1)	// not running
+	, running(false)
+	, validMask(640*480/64)
+	, trainingPhase(TRAINING_OFF)
+	, retrainRequested(false)
+	, idle(false)
+	, lastActivity(0)
+	, trainedFrames(0)
+	, background(480, 640, (short)0)
+	, noise(480, 640, 0.0f)
+	, median(480, 640)
+	, newBackground(480, 640)
+	, newNoise(480, 640)
+	, trainMask(640*480/64)
+	, depth8(480, 640)
+	, debug(480, 640)
+	, debugFront(480, 640)
+	, touchSequence(0)
+	, truthFrames(0), truthTouches(0), truthFound(0), falseTouches(0)
+	, truthError(0)
+{
+	pthread_mutex_init(&mutex, NULL);
+}
+
+TouchSensor::~TouchSensor() {
+	stop();
+	pthread_mutex_destroy(&mutex);
+	delete sensor;
+}
+
+int TouchSensor::start() {
+	sensor->setIngestArea(&activeArea);
+	die = 0;
+	running = true;
+	if (pthread_create(&thread, NULL, threadFunc, this)) {
+		printf("pthread_create failed\n");
+		return -1;
+	}
+	return 0;
+}
+
+void TouchSensor::stop() {
+	if (die) {
+		return;
+	}
+	die = 1;
+	pthread_join(thread, NULL);
+	sensor->close();
+}
+
+bool TouchSensor::getTouches(vector<Point2f>& result, unsigned int& sequence) {
+	pthread_mutex_lock(&mutex);
+	bool updated = touchSequence != sequence;
+	if (updated) {
+		result = touches;
+		sequence = touchSequence;
+	}
+	pthread_mutex_unlock(&mutex);
+	return updated;
+}
+
+void TouchSensor::showDebugFrame(const char* windowName) {
+	pthread_mutex_lock(&mutex);
+	imshow(windowName, debugFront);
+	pthread_mutex_unlock(&mutex);
+}
+
+void *TouchSensor::threadFunc(void *arg) {
+	((TouchSensor*)arg)->run();
+	return NULL;
+}
+
+// valid mask of the pixels inside the active area. the mask the sensor
+// built during ingest is used if there is one, otherwise only the words
+// covering the spans are built from the frame. the others are cleared.
+void TouchSensor::buildAreaValidMask(const uint16_t* depth) {
+	const int wordsPerRow = 640 / 64;
+	const uint64_t* area = activeArea.getMask();
+	const uint64_t* ingested = sensor->getValidMask();
+	uint16_t invalid = sensor->invalidDepth();
+	for (int y = 0; y < 480; y++) {
+		uint64_t* v = &validMask[y * wordsPerRow];
+		const uint64_t* a = area + y * wordsPerRow;
+		int k0, k1;
+		activeArea.getWordRange(y, k0, k1);
+		for (int k = 0; k < k0; k++) {
+			v[k] = 0;
+		}
+		if (ingested) {
+			for (int k = k0; k < k1; k++) {
+				v[k] = ingested[y * wordsPerRow + k];
+			}
+		} else if (k0 < k1) {
+			buildValidMask(depth + y * 640 + k0 * 64, invalid, v + k0, (k1 - k0) * 64);
+		}
+		for (int k = k0; k < k1; k++) {
+			v[k] &= a[k];
+		}
+		for (int k = k1; k < wordsPerRow; k++) {
+			v[k] = 0;
+		}
+	}
+}
+
+// follows slow changes of the background inside the active area, the
+// detector moves the touch bands of the adapted pixels along
+void TouchSensor::adaptArea(const uint16_t* depth) {
+	uint16_t invalid = sensor->invalidDepth();
+	for (int y = 0; y < 480; y++) {
+		const AreaSpan* spans = activeArea.getSpans(y);
+		for (int i = 0; i < activeArea.getSpanCount(y); i++) {
+			detector.adaptBackground(depth, invalid, y, spans[i].x0, spans[i].x1);
+		}
+	}
+}
+
+// create background model. returns false if the sensor ran out of frames.
+bool TouchSensor::trainBackground() {
+	KinnectFrameInfo frameInfo;
+
+	startTraining();
+	for (bool done = false; !done && !die; ) {
+		int res;
+		while ((res = sensor->waitFrame(frameInfo, frameTimeout)) == 0 && !die) {
+			printf("waiting for depth frames of sensor %s...\n", getSerial().c_str());
+		}
+		if (res < 0) {
+			return false;
+		}
+		uint16_t* depth = sensor->getDepthMap();
+		buildAreaValidMask(depth);
+		done = trainFrame(depth);
+		if (recorder) {
+			recorder->append(depth, frameInfo);
+		}
+	}
+	return true;
+}
+
+void TouchSensor::startTraining() {
+	// raw disparities are about four times coarser than millimeters at table distance
+	histogram.reset(sensor->invalidDepth() != 0 ? 2 : 4);
+	trainer.reset();
+	trainingPhase = robustTraining ? TRAINING_HISTOGRAM : TRAINING_MEAN;
+}
+
+/*
+ * adds one frame (validMask must be up to date) to the background in
+ * training. once complete, the new background replaces the current one and
+ * true is returned.
+ */
+bool TouchSensor::trainFrame(const uint16_t* depth) {
+	if (trainingPhase == TRAINING_HISTOGRAM) {
+		histogram.add(depth, &validMask[0]);
+		if (histogram.getFrameCount() >= nBackgroundTrain) {
+			histogram.getMedian((short*)median.data);
+			trainingPhase = TRAINING_MEAN;
+		}
+		return false;
+	}
+
+	const uint64_t* mask = &validMask[0];
+	if (robustTraining) {
+		restrictValidMask(depth, (short*)median.data, histogram.getBinSize(), &validMask[0], &trainMask[0], 640*480);
+		mask = &trainMask[0];
+	}
+	trainer.add(depth, mask);
+	if (trainer.getFrameCount() < nBackgroundTrain) {
+		return false;
+	}
+
+	// with hole filling, pixels seen in less than a quarter of the frames are holes too
+	trainer.getMean((short*)newBackground.data, holeFill > 0 ? trainer.getFrameCount() / 4 : 1);
+	trainer.getStdDev((float*)newNoise.data);
+	if (holeFill > 0) {
+		int filled = fillBackgroundHoles((short*)newBackground.data, (float*)newNoise.data, 640, 480, holeFill);
+		printf("sensor %s: %d background pixels filled\n", getSerial().c_str(), filled);
+	}
+
+	// swap the model in between two frames, the detector only sees complete models
+	std::swap(background, newBackground);
+	std::swap(noise, newNoise);
+	detector.setBackground(background, noise);
+	trainedFrames = trainer.getFrameCount();
+	trainingPhase = TRAINING_OFF;
+	return true;
+}
+
+// uses the saved background if the first frame still shows the same scene.
+// returns false if the background has to be trained.
+bool TouchSensor::loadSnapshot() {
+	BackgroundSnapshot snapshot;
+	if (snapshot.open(snapshotFile.c_str()) != 0) {
+		return false;
+	}
+	const SnapshotHeader& header = snapshot.getHeader();
+	const Rect& roi = detector.roi;
+	if (header.width != 640 || header.height != 480 || header.invalidDepth != sensor->invalidDepth()
+			|| header.roi[0] != roi.x || header.roi[1] != roi.y || header.roi[2] != roi.width || header.roi[3] != roi.height
+			|| (header.areaChecksum != 0 && header.areaChecksum != activeArea.getChecksum())) {
+		printf("sensor %s: %s was taken with a different setup, training\n", getSerial().c_str(), snapshotFile.c_str());
+		return false;
+	}
+
+	KinnectFrameInfo frameInfo;
+	int res;
+	while ((res = sensor->waitFrame(frameInfo, frameTimeout)) == 0 && !die) {
+		printf("waiting for depth frames of sensor %s...\n", getSerial().c_str());
+	}
+	if (res <= 0) {
+		return false;
+	}
+	uint16_t* depth = sensor->getDepthMap();
+	if (recorder) {
+		recorder->append(depth, frameInfo);
+	}
+
+	float changed = compareBackground(depth, snapshot.getBackground(), snapshot.getStdDev(), sensor->invalidDepth(),
+			header.touchDepthMin, header.touchDepthMax, header.noiseFactor, activeArea.getMask(), 640*480);
+	if (changed > snapshotMaxChanged) {
+		printf("sensor %s: scene changed since %s was saved (%.1f%% of the pixels), training\n", getSerial().c_str(), snapshotFile.c_str(), changed * 100);
+		return false;
+	}
+
+	memcpy(background.data, snapshot.getBackground(), 640*480*sizeof(short));
+	memcpy(noise.data, snapshot.getStdDev(), 640*480*sizeof(float));
+	detector.touchDepthMin = header.touchDepthMin;
+	detector.touchDepthMax = header.touchDepthMax;
+	detector.noiseFactor = header.noiseFactor;
+	detector.setBackground(background, noise);
+	trainedFrames = header.trainedFrames;
+	printf("sensor %s: background from %s (%.1f%% of the pixels changed)\n", getSerial().c_str(), snapshotFile.c_str(), changed * 100);
+	return true;
+}
+
+void TouchSensor::saveSnapshot() {
+	SnapshotHeader header;
+	memset(&header, 0, sizeof(header));
+	header.width = 640;
+	header.height = 480;
+	header.invalidDepth = sensor->invalidDepth();
+	header.trainedFrames = trainedFrames;
+	header.roi[0] = detector.roi.x;
+	header.roi[1] = detector.roi.y;
+	header.roi[2] = detector.roi.width;
+	header.roi[3] = detector.roi.height;
+	header.areaChecksum = activeArea.getChecksum();
+	header.touchDepthMin = detector.touchDepthMin;
+	header.touchDepthMax = detector.touchDepthMax;
+	header.noiseFactor = detector.noiseFactor;
+	BackgroundSnapshot::save(snapshotFile.c_str(), header, (const int16_t*)background.data, (const float*)noise.data);
+}
+
+void TouchSensor::run() {
+	KinnectFrameInfo frameInfo;
+	unsigned int framesProcessed = 0, framesSkipped = 0;
+	unsigned int framesTotal = 0;
+	double statsStart = (double)getTickCount();
+
+	if (snapshotFile.empty() || !loadSnapshot()) {
+		if (!trainBackground()) {
+			printf("sensor %s: not enough frames for the background model\n", getSerial().c_str());
+			running = false;
+			return;
+		}
+		if (!snapshotFile.empty()) {
+			saveSnapshot();
+		}
+	}
+
+	double runStart = (double)getTickCount();
+	lastActivity = runStart;
+	while (!die) {
+		// データ読み取り
+		// wait for a new frame, never process the same frame twice
+		int res = sensor->waitFrame(frameInfo, frameTimeout);
+		if (res < 0) {
+			break;
+		}
+		if (res == 0) {
+			continue;
+		}
+		framesTotal++;
+		framesSkipped += frameInfo.skipped;
+		if (++framesProcessed == statsInterval) {
+			double seconds = ((double)getTickCount() - statsStart) / getTickFrequency();
+			printf("sensor %s frame %u: %.1f fps, %u frames skipped\n", getSerial().c_str(), frameInfo.sequence, framesProcessed / seconds, framesSkipped);
+			framesProcessed = framesSkipped = 0;
+			statsStart = (double)getTickCount();
+		}
+
+		// update 16 bit depth matrix
+		short *depthData = (short*)sensor->getDepthMap();
+		Mat1s depth(480, 640, depthData);
+		if (recorder) {
+			recorder->append((uint16_t*)depthData, frameInfo);
+		}
+		if (skipIdleFrame(depth, framesTotal)) {
+			continue;
+		}
+		buildAreaValidMask((uint16_t*)depthData);
+
+		// タッチ位置を探す
+		detector.detect(depth, &validMask[0], touchPoints);
+		if (sensor->getGroundTruth(truth)) {
+			scoreTouches();
+		}
+
+		// retrain in the background if requested
+		if (retrainRequested) {
+			retrainRequested = false;
+			printf("sensor %s: retraining background\n", getSerial().c_str());
+			startTraining();
+		}
+		if (trainingPhase != TRAINING_OFF && trainFrame((uint16_t*)depthData)) {
+			printf("sensor %s: new background in use\n", getSerial().c_str());
+			if (!snapshotFile.empty()) {
+				saveSnapshot();
+			}
+		}
+
+		// follow slow changes of the surface where nothing is in front of it
+		if (adaptInterval > 0 && framesTotal % adaptInterval == 0) {
+			adaptArea((uint16_t*)depthData);
+		}
+
+		if (debugEnabled) {
+			renderDebugFrame(depth);
+		}
+
+		// map to surface coordinates and publish
+		const Rect& roi = detector.roi;
+		pthread_mutex_lock(&mutex);
+		touches.resize(touchPoints.size());
+		for (unsigned int i = 0; i < touchPoints.size(); i++) {
+			float u = 1 - (touchPoints[i].x - roi.x) / roi.width;
+			float v = 1 - (touchPoints[i].y - roi.y) / roi.height;	//安東さん用
+			touches[i].x = surfaceX0 + u * (surfaceX1 - surfaceX0);
+			touches[i].y = surfaceY0 + v * (surfaceY1 - surfaceY0);
+		}
+		touchSequence = frameInfo.sequence;
+		if (debugEnabled) {
+			std::swap(debug, debugFront);
+		}
+		pthread_mutex_unlock(&mutex);
+	}
+
+	// keep the adapted background for the next start
+	if (!snapshotFile.empty()) {
+		saveSnapshot();
+	}
+
+	double seconds = ((double)getTickCount() - runStart) / getTickFrequency();
+	printf("sensor %s: %u frames in %.2f s (%.1f fps)\n", getSerial().c_str(), framesTotal, seconds, framesTotal / seconds);
+	if (truthFrames > 0) {
+		printf("sensor %s: %.1f touches per frame, %.1f%% found, %u false touches (%.2f per frame), mean error %.2f px\n",
+				getSerial().c_str(), (double)truthTouches / truthFrames,
+				truthTouches ? 100.0 * truthFound / truthTouches : 100.0,
+				falseTouches, (double)falseTouches / truthFrames,
+				truthFound ? truthError / truthFound : 0.0);
+	}
+	running = false;
+}
+
+// idle governor, returns true if the frame is not detected. training
+// always gets every frame.
+bool TouchSensor::skipIdleFrame(const Mat1s& depth, unsigned int frame) {
+	if (idleSeconds <= 0 || trainingPhase != TRAINING_OFF || retrainRequested) {
+		return false;
+	}
+
+	double now = (double)getTickCount();
+	if (detector.findForeground(depth, idleGridStep, idleWakePixels)) {
+		lastActivity = now;
+		if (idle) {
+			printf("sensor %s: active\n", getSerial().c_str());
+			idle = false;
+			sensor->setIdle(false);
+		}
+	} else if (!idle && now - lastActivity > idleSeconds * getTickFrequency()) {
+		printf("sensor %s: idle, detecting every %u. frame\n", getSerial().c_str(), idleStride);
+		idle = true;
+		sensor->setIdle(true);
+	}
+	return idle && frame % idleStride != 0;
+}
+
+// matches every true touch with the closest unused detected touch
+void TouchSensor::scoreTouches() {
+	vector<bool> used(touchPoints.size(), false);
+	unsigned int found = 0;
+	for (unsigned int i = 0; i < truth.size(); i++) {
+		int closest = -1;
+		float closestDistance = truthRadius * truthRadius;
+		for (unsigned int j = 0; j < touchPoints.size(); j++) {
+			float dx = touchPoints[j].x - truth[i].x, dy = touchPoints[j].y - truth[i].y;
+			if (!used[j] && dx * dx + dy * dy < closestDistance) {
+				closest = j;
+				closestDistance = dx * dx + dy * dy;
+			}
+		}
+		if (closest >= 0) {
+			used[closest] = true;
+			found++;
+			truthError += sqrt(closestDistance);
+		}
+	}
+	truthFrames++;
+	truthTouches += truth.size();
+	truthFound += found;
+	falseTouches += touchPoints.size() - found;
+}
+
+void TouchSensor::renderDebugFrame(const Mat1s& depth) {
+	// render depth to debug frame
+	depth.convertTo(depth8, CV_8U, 255 / debugFrameMaxDepth);
+	cvtColor(/* in */depth8, /* out*/debug, /* 変換方法 */CV_GRAY2BGR);
+
+	// ヒートマップの描画
+	detector.getTouchMask(touchMask);
+	debug.setTo(debugColor0, touchMask);  // touch mask
+	//rectangle(debug, detector.roi, debugColor1, 2); // surface boundaries
+
+	// タッチ位置の描画
+	for (unsigned int i = 0; i < touchPoints.size(); i++) { // touch points
+		circle(debug, touchPoints[i], 5, debugColor2, CV_FILLED);
+	}
+}
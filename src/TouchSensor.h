@@ -0,0 +1,136 @@
+//============================================================================
+// Name        : TouchSensor.h
+// Description : capture and segmentation thread of one depth sensor
+//============================================================================
+
+#ifndef INCLUDED_TouchSensor_H
+#define INCLUDED_TouchSensor_H
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+#include <opencv/cv.h>
+
+#include "DepthSensor.h"
+#include "DepthRecording.h"
+#include "BackgroundModel.h"
+#include "BackgroundSnapshot.h"
+#include "TouchDetector.h"
+#include "ActiveArea.h"
+
+/*
+ * runs background training and touch detection for one sensor on its own
+ * thread. touches are published in surface coordinates: the sensor's roi
+ * is mapped (mirrored in x and y) onto [surfaceX0,surfaceX1]x[surfaceY0,surfaceY1]
+ * of the shared surface, which spans 0..1 in both directions.
+ */
+class TouchSensor {
+public:
+	TouchDetector detector;
+
+	/*
+	 * pixels covering the surface. ingest, training, adaption and detection
+	 * only visit these, detector.roi has to be their bounding box.
+	 */
+	ActiveArea activeArea;
+	float surfaceX0, surfaceY0, surfaceX1, surfaceY1;
+	bool debugEnabled;	// render the debug visualization
+	DepthRecorder* recorder;	// if set, every captured frame is appended to it (not owned)
+	unsigned int adaptInterval;	// adapt the background every n frames (0: keep the trained background)
+	std::string snapshotFile;	// if set, the background is loaded from and saved to this file
+	int holeFill;				// fill background holes up to this width (pixels, 0: off)
+	bool robustTraining;		// median based training, tolerates hands on the table
+
+	/*
+	 * idle governor: after idleSeconds without anything in front of the
+	 * surface only every idleStride-th frame is detected (and rendered).
+	 * every frame is still checked for foreground on a coarse grid, the
+	 * first one with a hand is detected at once. 0: always full rate.
+	 */
+	float idleSeconds;
+	unsigned int idleStride;
+
+	// takes ownership of sensor
+	TouchSensor(DepthSensor* sensor, unsigned int nBackgroundTrain);
+	~TouchSensor();
+
+	int start();
+	void stop();
+
+	// false once the sensor ran out of frames (end of a replayed file)
+	bool isRunning() const { return running; }
+
+	/*
+	 * trains a new background from the next frames while touches are still
+	 * detected with the current one, which is then replaced between two frames.
+	 */
+	void retrain() { retrainRequested = true; }
+
+	/*
+	 * copies the touches of the newest processed frame if it is newer than
+	 * sequence (which is updated). returns false if there was no new frame.
+	 */
+	bool getTouches(std::vector<cv::Point2f>& touches, unsigned int& sequence);
+
+	// shows the debug visualization of the newest processed frame
+	void showDebugFrame(const char* windowName);
+
+	const std::string& getSerial() const { return sensor->getSerial(); }
+
+private:
+	DepthSensor* sensor;
+	unsigned int nBackgroundTrain;
+
+	int die;
+	volatile bool running;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+
+	std::vector<uint64_t> validMask;	// pixels of the current frame with a reading, see buildValidMask
+	enum TrainingPhase {
+		TRAINING_OFF,
+		TRAINING_HISTOGRAM,	// robust training: median per pixel
+		TRAINING_MEAN		// mean and deviation (near the median in robust training)
+	};
+	TrainingPhase trainingPhase;
+	volatile bool retrainRequested;
+	bool idle;
+	double lastActivity;	// tick count of the last frame with foreground
+	HistogramTrainer histogram;
+	BackgroundTrainer trainer;
+	unsigned int trainedFrames;
+	cv::Mat1s background;
+	cv::Mat1f noise;		// standard deviation of the background
+	cv::Mat1s median;		// robust training only
+	cv::Mat1s newBackground;
+	cv::Mat1f newNoise;
+	std::vector<uint64_t> trainMask;
+	cv::Mat1b depth8;
+	cv::Mat1b touchMask;		// unpacked touch mask of the detector
+	cv::Mat3b debug, debugFront;	// debug visualization, debugFront is guarded by mutex
+
+	std::vector<cv::Point2f> touchPoints;	// sensor coordinates
+	std::vector<cv::Point2f> touches;		// surface coordinates, guarded by mutex
+	unsigned int touchSequence;				// guarded by mutex
+
+	// detection accuracy against the ground truth of synthetic sources
+	std::vector<GroundTruthTouch> truth;
+	unsigned int truthFrames, truthTouches, truthFound, falseTouches;
+	double truthError;
+
+	static void *threadFunc(void *arg);
+	void run();
+	void buildAreaValidMask(const uint16_t* depth);
+	void adaptArea(const uint16_t* depth);
+	bool trainBackground();
+	void startTraining();
+	bool trainFrame(const uint16_t* depth);
+	bool loadSnapshot();
+	void saveSnapshot();
+	void renderDebugFrame(const cv::Mat1s& depth);
+	void scoreTouches();
+	bool skipIdleFrame(const cv::Mat1s& depth, unsigned int frame);
+};
+
+#endif